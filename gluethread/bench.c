@@ -0,0 +1,121 @@
+#include "glthread.h"
+#include "glprioq.h"
+#include <memory.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+/*Timer queue benchmark : the queue is filled with queue_size timers,
+    then every operation expires the earliest timer and re-arms it at a
+    random later time (hold model). glthread_priority_insert and glprioq
+    run the same sequence of keys.
+
+    gcc -O2 bench.c glthread.c glprioq.c -o bench*/
+
+typedef struct _timer{
+
+    unsigned long expiry;
+    glthread_t glthread;
+    glprioq_node_t glprioq_node;
+} job_timer_t;
+
+GLTHREAD_TO_STRUCT(thread_to_timer, job_timer_t, glthread);
+GLPRIOQ_TO_STRUCT(glprioq_node_to_timer, job_timer_t, glprioq_node);
+
+#define OPERATIONS 20000
+
+static int earlier_expiry(void *t1, void *t2){
+
+    if(((job_timer_t *)t1)->expiry == ((job_timer_t *)t2)->expiry) return 0;
+    if(((job_timer_t *)t1)->expiry < ((job_timer_t *)t2)->expiry) return -1;
+    return 1;
+}
+
+static unsigned long seed;
+
+static unsigned long next_delay(){
+
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    return (seed >> 33) % 1000000;
+}
+
+static double now_ns(){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench_glthread(job_timer_t *timers, int queue_size, unsigned long *check){
+
+    glthread_t base_glthread;
+    int i;
+
+    init_glthread(&base_glthread);
+    seed = 1;
+    for(i = 0; i < queue_size; i++){
+        timers[i].expiry = next_delay();
+        glthread_priority_insert(&base_glthread, &timers[i].glthread,
+            earlier_expiry, offsetof(job_timer_t, glthread));
+    }
+
+    double start = now_ns();
+    for(i = 0; i < OPERATIONS; i++){
+        job_timer_t *timer = thread_to_timer(dequeue_glthread_first(&base_glthread));
+        *check += timer->expiry;
+        timer->expiry += next_delay();
+        glthread_priority_insert(&base_glthread, &timer->glthread,
+            earlier_expiry, offsetof(job_timer_t, glthread));
+    }
+    return (now_ns() - start) / OPERATIONS;
+}
+
+static double bench_glprioq(job_timer_t *timers, int queue_size, unsigned long *check){
+
+    glprioq_t glprioq;
+    int i;
+
+    init_glprioq(&glprioq, earlier_expiry, offsetof(job_timer_t, glprioq_node));
+    seed = 1;
+    for(i = 0; i < queue_size; i++){
+        timers[i].expiry = next_delay();
+        glprioq_insert(&glprioq, &timers[i].glprioq_node);
+    }
+
+    double start = now_ns();
+    for(i = 0; i < OPERATIONS; i++){
+        job_timer_t *timer = glprioq_node_to_timer(dequeue_glprioq_first(&glprioq));
+        *check += timer->expiry;
+        timer->expiry += next_delay();
+        glprioq_insert(&glprioq, &timer->glprioq_node);
+    }
+    return (now_ns() - start) / OPERATIONS;
+}
+
+int main(int argc, char **argv){
+
+    int queue_sizes[] = {10, 100, 1000, 5000, 20000};
+    int i;
+
+    printf("%-10s %16s %16s\n", "timers", "glthread ns/op", "glprioq ns/op");
+
+    for(i = 0; i < sizeof(queue_sizes) / sizeof(queue_sizes[0]); i++){
+
+        job_timer_t *timers = calloc(queue_sizes[i], sizeof(job_timer_t));
+        unsigned long check_glthread = 0, check_glprioq = 0;
+
+        double glthread_ns = bench_glthread(timers, queue_sizes[i], &check_glthread);
+        double glprioq_ns = bench_glprioq(timers, queue_sizes[i], &check_glprioq);
+
+        /*Both must have expired the same timers in the same order*/
+        if(check_glthread != check_glprioq){
+            printf("Error : glprioq and glthread disagree for %d timers\n", queue_sizes[i]);
+            return 1;
+        }
+
+        printf("%-10d %16.1f %16.1f\n", queue_sizes[i], glthread_ns, glprioq_ns);
+        free(timers);
+    }
+    return 0;
+}
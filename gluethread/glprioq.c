@@ -0,0 +1,190 @@
+#include "glprioq.h"
+#include <stdlib.h>
+
+#define GLPRIOQ_USER_DATA(glprioqptr, nodeptr) \
+    (void *)((char *)(nodeptr) - (glprioqptr)->offset)
+
+/*xorshift32, node priorities only need to be spread out. The state is
+    per queue, queues used by different threads share nothing*/
+static unsigned int glprioq_random(glprioq_t *glprioq){
+
+    unsigned int x = glprioq->random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    glprioq->random_state = x;
+    return x;
+}
+
+void init_glprioq(glprioq_t *glprioq,
+                  int (*comp_fn)(void *, void *),
+                  int offset){
+
+    glprioq->root = NULL;
+    glprioq->first = NULL;
+    glprioq->last = NULL;
+    glprioq->count = 0;
+    glprioq->comp_fn = comp_fn;
+    glprioq->offset = offset;
+    glprioq->random_state = 2463534242u;
+}
+
+void init_glprioq_node(glprioq_node_t *node){
+
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = NULL;
+    node->priority = 0;
+    node->queued = 0;
+}
+
+static void glprioq_replace_child(glprioq_t *glprioq,
+                                  glprioq_node_t *parent,
+                                  glprioq_node_t *old_child,
+                                  glprioq_node_t *new_child){
+
+    if(!parent)
+        glprioq->root = new_child;
+    else if(parent->left == old_child)
+        parent->left = new_child;
+    else
+        parent->right = new_child;
+
+    if(new_child)
+        new_child->parent = parent;
+}
+
+/*Rotate node above its parent, in order is unchanged*/
+static void glprioq_rotate_up(glprioq_t *glprioq, glprioq_node_t *node){
+
+    glprioq_node_t *parent = node->parent;
+
+    if(parent->left == node){
+        parent->left = node->right;
+        if(node->right)
+            node->right->parent = parent;
+        node->right = parent;
+    }else {
+        parent->right = node->left;
+        if(node->left)
+            node->left->parent = parent;
+        node->left = parent;
+    }
+
+    glprioq_replace_child(glprioq, parent->parent, parent, node);
+    parent->parent = node;
+}
+
+void glprioq_insert(glprioq_t *glprioq, glprioq_node_t *node){
+
+    glprioq_node_t *curr = glprioq->root, *parent = NULL;
+    void *data = GLPRIOQ_USER_DATA(glprioq, node);
+    int go_left = 0;
+
+    init_glprioq_node(node);
+    node->priority = glprioq_random(glprioq);
+    node->queued = 1;
+
+    while(curr){
+        parent = curr;
+        go_left = glprioq->comp_fn(data, GLPRIOQ_USER_DATA(glprioq, curr)) == -1;
+        curr = go_left ? curr->left : curr->right;
+    }
+
+    node->parent = parent;
+    if(!parent)
+        glprioq->root = node;
+    else if(go_left)
+        parent->left = node;
+    else
+        parent->right = node;
+
+    while(node->parent && node->priority < node->parent->priority)
+        glprioq_rotate_up(glprioq, node);
+
+    if(!glprioq->first ||
+        glprioq->comp_fn(data, GLPRIOQ_USER_DATA(glprioq, glprioq->first)) == -1)
+        glprioq->first = node;
+
+    if(!glprioq->last ||
+        glprioq->comp_fn(data, GLPRIOQ_USER_DATA(glprioq, glprioq->last)) != -1)
+        glprioq->last = node;
+
+    glprioq->count++;
+}
+
+void glprioq_remove(glprioq_t *glprioq, glprioq_node_t *node){
+
+    glprioq_node_t *child = NULL;
+
+    if(!node->queued)
+        return;
+
+    if(glprioq->first == node)
+        glprioq->first = glprioq_next(node);
+    if(glprioq->last == node)
+        glprioq->last = glprioq_prev(node);
+
+    /*Rotate the node down to a leaf, keeping the heap order of the rest*/
+    while(node->left || node->right){
+        if(!node->left)
+            child = node->right;
+        else if(!node->right)
+            child = node->left;
+        else
+            child = node->left->priority < node->right->priority ?
+                        node->left : node->right;
+        glprioq_rotate_up(glprioq, child);
+    }
+
+    glprioq_replace_child(glprioq, node->parent, node, NULL);
+    init_glprioq_node(node);
+    glprioq->count--;
+}
+
+glprioq_node_t *dequeue_glprioq_first(glprioq_t *glprioq){
+
+    glprioq_node_t *node = glprioq->first;
+
+    if(node)
+        glprioq_remove(glprioq, node);
+    return node;
+}
+
+glprioq_node_t *dequeue_glprioq_last(glprioq_t *glprioq){
+
+    glprioq_node_t *node = glprioq->last;
+
+    if(node)
+        glprioq_remove(glprioq, node);
+    return node;
+}
+
+glprioq_node_t *glprioq_next(glprioq_node_t *node){
+
+    if(node->right){
+        node = node->right;
+        while(node->left)
+            node = node->left;
+        return node;
+    }
+
+    while(node->parent && node->parent->right == node)
+        node = node->parent;
+    return node->parent;
+}
+
+glprioq_node_t *glprioq_prev(glprioq_node_t *node){
+
+    if(node->left){
+        node = node->left;
+        while(node->right)
+            node = node->right;
+        return node;
+    }
+
+    while(node->parent && node->parent->left == node)
+        node = node->parent;
+    return node->parent;
+}
@@ -0,0 +1,75 @@
+#ifndef __GLPRIOQ__
+#define __GLPRIOQ__
+
+/*Intrusive ordered container, the companion of glthread_priority_insert
+    for long queues. It is a treap : a binary search tree ordered by
+    comp_fn, balanced by a random priority per node, so that insert
+    and remove take O(log n) expected time. The first and the last
+    node are cached and read in O(1)*/
+
+typedef struct _glprioq_node{
+
+    struct _glprioq_node *left;
+    struct _glprioq_node *right;
+    struct _glprioq_node *parent;
+    unsigned int priority;  /*random, min heap ordered*/
+    unsigned int queued;
+} glprioq_node_t;
+
+typedef struct _glprioq{
+
+    glprioq_node_t *root;
+    glprioq_node_t *first;
+    glprioq_node_t *last;
+    unsigned int count;
+    /*Same convention as glthread_priority_insert : -1 when the first
+        structure goes before the second, equal ones keep insertion order*/
+    int (*comp_fn)(void *, void *);
+    int offset;
+    unsigned int random_state;  /*of node priorities*/
+} glprioq_t;
+
+#define GLPRIOQ_TO_STRUCT(fn_name, structure_name, field_name) \
+    static inline structure_name* fn_name(glprioq_node_t* nodeptr){ \
+        return (structure_name*)((char*)(nodeptr) - (char*)&(((structure_name*)0)->field_name));    \
+    }
+
+#define IS_QUEUED_UP_IN_GLPRIOQ(nodeptr) ((nodeptr)->queued)
+
+#define GLPRIOQ_FIRST(glprioqptr)   ((glprioqptr)->first)
+
+#define GLPRIOQ_LAST(glprioqptr)    ((glprioqptr)->last)
+
+#define GLPRIOQ_COUNT(glprioqptr)   ((glprioqptr)->count)
+
+/*In order, delete safe loop*/
+#define ITERATE_GLPRIOQ_BEGIN(glprioqptr, nodeptr)   \
+{   \
+    glprioq_node_t *_glprioq_next = NULL;   \
+    nodeptr = GLPRIOQ_FIRST(glprioqptr);    \
+    for(; nodeptr != NULL; nodeptr = _glprioq_next){ \
+        _glprioq_next = glprioq_next(nodeptr);
+
+#define ITERATE_GLPRIOQ_END(glprioqptr, nodeptr) \
+    }}
+
+void init_glprioq(glprioq_t *glprioq,
+                  int (*comp_fn)(void *, void *),
+                  int offset);
+
+void init_glprioq_node(glprioq_node_t *node);
+
+void glprioq_insert(glprioq_t *glprioq, glprioq_node_t *node);
+
+void glprioq_remove(glprioq_t *glprioq, glprioq_node_t *node);
+
+glprioq_node_t *dequeue_glprioq_first(glprioq_t *glprioq);
+
+glprioq_node_t *dequeue_glprioq_last(glprioq_t *glprioq);
+
+/*In order neighbours, NULL past the ends*/
+glprioq_node_t *glprioq_next(glprioq_node_t *node);
+
+glprioq_node_t *glprioq_prev(glprioq_node_t *node);
+
+#endif  /*__GLPRIOQ__*/
@@ -95,18 +95,19 @@ unsigned int get_glthread_list_count(glthread_t *glthread_head){
     return count;
 }
 
-void glthread_priority_insert(glthread_t *glthread_head, 
+unsigned int glthread_priority_insert(glthread_t *glthread_head, 
                             glthread_t *glthread,
                             int (*comp_fn)(void *, void *),
                             int offset){
 
     glthread_t *curr = NULL, *prev = NULL;
+    unsigned int compared = 0;
 
     init_glthread(glthread);
 
     if(IS_GLTHREAD_LIST_EMPTY(glthread_head)){
         glthread_add_next(glthread_head, glthread);
-        return;
+        return compared;
     }
 
     /* Only one node*/
@@ -117,11 +118,12 @@ void glthread_priority_insert(glthread_t *glthread_head,
         }else {
             glthread_add_next(glthread_head->right, glthread);
         }
-        return;
+        return 1;
     }
 
     ITERATE_GLTHREAD_BEGIN(glthread_head, curr){
 
+        compared++;
         if(comp_fn(GLTHREAD_GET_USER_DATA_FROM_OFFSET(glthread, offset),
             GLTHREAD_GET_USER_DATA_FROM_OFFSET(curr, offset)) != -1){
             prev = curr;
@@ -133,12 +135,13 @@ void glthread_priority_insert(glthread_t *glthread_head,
         else
             glthread_add_next(prev, glthread);
 
-        return;
+        return compared;
 
     }ITERATE_GLTHREAD_END(glthread_head, curr);
 
     /*Add in the end*/
     glthread_add_next(prev, glthread);
+    return compared;
 }
 
 glthread_t* dequeue_glthread_first(glthread_t *base_glthread){
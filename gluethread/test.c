@@ -1,6 +1,8 @@
 #include "glthread.h"
+#include "glprioq.h"
 #include <memory.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef struct _person{
@@ -8,6 +10,7 @@ typedef struct _person{
     int age;
     int weight;
     glthread_t glthread;
+    glprioq_node_t glprioq_node;
 } person_t;
 
 int senior_citizen(person_t *p1, person_t *p2){
@@ -21,6 +24,175 @@ int senior_citizen(person_t *p1, person_t *p2){
     (unsigned int)&(((struct_name *)0)->fld_name)
 
 GLTHREAD_TO_STRUCT(thread_to_person, person_t, glthread);
+GLPRIOQ_TO_STRUCT(glprioq_node_to_person, person_t, glprioq_node);
+
+static int failures = 0;
+
+#define TEST_CHECK(cond)    \
+    do{ \
+        if(!(cond)){   \
+            failures++; \
+            printf("FAILED %s() : %s\n", __FUNCTION__, #cond); \
+        }   \
+    } while(0)
+
+int younger(void *p1, void *p2){
+
+    if(((person_t *)p1)->age == ((person_t *)p2)->age) return 0;
+    if(((person_t *)p1)->age < ((person_t *)p2)->age) return -1;
+    return 1;
+}
+
+/*In order walk : ages never decrease and, among equal ages, weights
+    (the insertion order) increase. Returns the number of nodes seen*/
+static unsigned int glprioq_check_order(glprioq_t *glprioq){
+
+    glprioq_node_t *node = NULL;
+    person_t *p = NULL, *prev = NULL;
+    unsigned int count = 0;
+
+    ITERATE_GLPRIOQ_BEGIN(glprioq, node){
+
+        p = glprioq_node_to_person(node);
+        TEST_CHECK(!prev || prev->age < p->age ||
+                   (prev->age == p->age && prev->weight < p->weight));
+        TEST_CHECK(glprioq_prev(node) == (prev ? &prev->glprioq_node : NULL));
+        prev = p;
+        count++;
+    } ITERATE_GLPRIOQ_END(glprioq, node);
+
+    TEST_CHECK(count == GLPRIOQ_COUNT(glprioq));
+    TEST_CHECK(GLPRIOQ_LAST(glprioq) == (prev ? &prev->glprioq_node : NULL));
+    return count;
+}
+
+static void test_glprioq_empty(){
+
+    glprioq_t glprioq;
+
+    init_glprioq(&glprioq, younger, offsetof(person_t, glprioq_node));
+    TEST_CHECK(GLPRIOQ_FIRST(&glprioq) == NULL);
+    TEST_CHECK(GLPRIOQ_LAST(&glprioq) == NULL);
+    TEST_CHECK(GLPRIOQ_COUNT(&glprioq) == 0);
+    TEST_CHECK(dequeue_glprioq_first(&glprioq) == NULL);
+    TEST_CHECK(dequeue_glprioq_last(&glprioq) == NULL);
+    TEST_CHECK(glprioq_check_order(&glprioq) == 0);
+}
+
+/*Random keys with many duplicates come out sorted, equal keys in the
+    order they were inserted*/
+static void test_glprioq_order(){
+
+    int i;
+    glprioq_t glprioq;
+    person_t *person = calloc(1000, sizeof(person_t));
+    glprioq_node_t *node = NULL;
+
+    init_glprioq(&glprioq, younger, offsetof(person_t, glprioq_node));
+    srand(7);
+    for(i = 0; i < 1000; i++){
+        person[i].age = rand() % 50;
+        person[i].weight = i;
+        glprioq_insert(&glprioq, &person[i].glprioq_node);
+        TEST_CHECK(IS_QUEUED_UP_IN_GLPRIOQ(&person[i].glprioq_node));
+    }
+    TEST_CHECK(glprioq_check_order(&glprioq) == 1000);
+
+    /*Drain from both ends*/
+    for(i = 0; i < 500; i++){
+        node = dequeue_glprioq_first(&glprioq);
+        TEST_CHECK(node && !IS_QUEUED_UP_IN_GLPRIOQ(node));
+        TEST_CHECK(!GLPRIOQ_FIRST(&glprioq) ||
+                   younger(glprioq_node_to_person(GLPRIOQ_FIRST(&glprioq)),
+                           glprioq_node_to_person(node)) != -1);
+        node = dequeue_glprioq_last(&glprioq);
+        TEST_CHECK(node != NULL);
+    }
+    TEST_CHECK(GLPRIOQ_COUNT(&glprioq) == 0);
+    TEST_CHECK(GLPRIOQ_FIRST(&glprioq) == NULL && GLPRIOQ_LAST(&glprioq) == NULL);
+    free(person);
+}
+
+static void test_glprioq_fifo(){
+
+    int i;
+    glprioq_t glprioq;
+    person_t person[10];
+
+    memset(person, 0, sizeof(person));
+    init_glprioq(&glprioq, younger, offsetof(person_t, glprioq_node));
+    for(i = 0; i < 10; i++){
+        person[i].age = 30;
+        person[i].weight = i;
+        glprioq_insert(&glprioq, &person[i].glprioq_node);
+    }
+
+    for(i = 0; i < 10; i++)
+        TEST_CHECK(dequeue_glprioq_first(&glprioq) == &person[i].glprioq_node);
+}
+
+/*Removing the first, a middle and the last node keeps the rest in
+    order and the cached ends right*/
+static void test_glprioq_remove(){
+
+    int i;
+    glprioq_t glprioq;
+    person_t person[9];
+
+    memset(person, 0, sizeof(person));
+    init_glprioq(&glprioq, younger, offsetof(person_t, glprioq_node));
+    for(i = 0; i < 9; i++){
+        person[i].age = (i * 5) % 9;    /*every age once, out of order*/
+        person[i].weight = i;
+        glprioq_insert(&glprioq, &person[i].glprioq_node);
+    }
+
+    /*person[0] is age 0, person[2] age 1, person[4] age 2,
+        person[7] age 8*/
+    TEST_CHECK(GLPRIOQ_FIRST(&glprioq) == &person[0].glprioq_node);
+    glprioq_remove(&glprioq, &person[0].glprioq_node);
+    TEST_CHECK(GLPRIOQ_FIRST(&glprioq) == &person[2].glprioq_node);
+    TEST_CHECK(!IS_QUEUED_UP_IN_GLPRIOQ(&person[0].glprioq_node));
+
+    glprioq_remove(&glprioq, &person[4].glprioq_node);
+    TEST_CHECK(glprioq_next(&person[2].glprioq_node) != &person[4].glprioq_node);
+
+    TEST_CHECK(GLPRIOQ_LAST(&glprioq) == &person[7].glprioq_node);
+    glprioq_remove(&glprioq, &person[7].glprioq_node);
+    TEST_CHECK(GLPRIOQ_LAST(&glprioq) != &person[7].glprioq_node);
+
+    /*Removing a node not queued is a no-op*/
+    glprioq_remove(&glprioq, &person[7].glprioq_node);
+    TEST_CHECK(glprioq_check_order(&glprioq) == 6);
+
+    /*Removed nodes can be queued again*/
+    glprioq_insert(&glprioq, &person[0].glprioq_node);
+    TEST_CHECK(GLPRIOQ_FIRST(&glprioq) == &person[0].glprioq_node);
+    TEST_CHECK(glprioq_check_order(&glprioq) == 7);
+}
+
+/*Node priorities come from the queue : inserting into one queue does
+    not change the shape another one gets*/
+static void test_glprioq_independent(){
+
+    int i;
+    glprioq_t glprioq[2];
+    person_t person[2][20];
+
+    memset(person, 0, sizeof(person));
+    init_glprioq(&glprioq[0], younger, offsetof(person_t, glprioq_node));
+    init_glprioq(&glprioq[1], younger, offsetof(person_t, glprioq_node));
+    for(i = 0; i < 20; i++){
+        person[0][i].age = person[1][i].age = i;
+        glprioq_insert(&glprioq[0], &person[0][i].glprioq_node);
+        glprioq_insert(&glprioq[1], &person[1][i].glprioq_node);
+    }
+
+    for(i = 0; i < 20; i++)
+        TEST_CHECK(person[0][i].glprioq_node.priority ==
+                   person[1][i].glprioq_node.priority);
+    TEST_CHECK(glprioq_check_order(&glprioq[0]) == 20);
+}
 
 int main(int agec, char **argv){
 
@@ -53,5 +225,12 @@ int main(int agec, char **argv){
         printf("Age = %d\n", p->age);
     } ITERATE_GLTHREAD_END(&base_glthread, curr);
 
-    return 0;
+    test_glprioq_empty();
+    test_glprioq_order();
+    test_glprioq_fifo();
+    test_glprioq_remove();
+    test_glprioq_independent();
+    printf("glprioq : %d check(s) failed\n", failures);
+
+    return failures ? 1 : 0;
 }
\ No newline at end of file
@@ -5,6 +5,30 @@
 #include <unistd.h> /*for getpagesize*/
 #include <sys/mman.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <sys/file.h> /*for flock*/
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*Per-CPU caches need restartable sequences (glibc registers them) and
+	the rseq flavour of membarrier, the critical sections are x86_64*/
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>) && __has_include(<linux/membarrier.h>)
+#include <sys/rseq.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#define MM_RSEQ
+#endif
+#endif
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
 
 /* #define __USE_MMAP__
 #undef __USE_BRK__
@@ -12,482 +36,3909 @@
 
 static vm_page_for_families_t *first_vm_page_for_families = NULL;
 static size_t SYSTEM_PAGE_SIZE = 0;
+static mm_shared_heap_t *shared_heap = NULL;
+static int mm_persistent_fd = -1; /*persistent heap file, locked while open*/
+static uint32_t page_family_generation = 0; /*bumped when family records move*/
+static vm_bool_t mm_adaptive_strategy = MM_FALSE;
+static vm_bool_t mm_cpu_caches_on = MM_FALSE;
+static uint32_t mm_cpu_count = 0; /*size of a family cpu_caches array*/
+static mm_budget_t mm_budget;
 
-void mm_init()
+/*Process local lock, taken by entry points once the memory manager
+	is used from more than one thread (background scavenger running).
+	Recursive, so that the pressure callback can call back into it*/
+static pthread_mutex_t mm_local_mutex;
+static vm_bool_t mm_thread_safe = MM_FALSE;
+static pthread_t mm_scavenger_thread;
+static volatile vm_bool_t mm_scavenger_running = MM_FALSE;
+static uint32_t mm_scavenger_interval_ms;
+static uint32_t mm_scavenger_pages_per_step;
+static pthread_once_t mm_thread_safe_once = PTHREAD_ONCE_INIT;
+
+/*Incremental heap verifier, resumes at family ordinal/page index*/
+static uint32_t mm_verify_family_ordinal = 0;
+static uint32_t mm_verify_page_index = 0;
+static void (*mm_verify_cb)(char *struct_name, void *vm_page,
+							void *block, char *problem) = NULL;
+static pthread_t mm_verifier_thread;
+static volatile vm_bool_t mm_verifier_running = MM_FALSE;
+static uint32_t mm_verifier_interval_ms;
+static uint32_t mm_verifier_pages_per_step;
+
+/*Epoch based reclamation*/
+static pthread_mutex_t mm_epoch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t mm_epoch_global = 0;
+static glthread_t mm_epoch_limbo[MM_EPOCH_LIMBO_LISTS];
+static uint32_t mm_epoch_retired = 0; /*since the last advance attempt*/
+static mm_epoch_thread_t *mm_epoch_threads = NULL; /*live threads, under mm_epoch_mutex*/
+static __thread mm_epoch_thread_t *mm_epoch_self = NULL;
+static pthread_key_t mm_epoch_thread_key;
+static pthread_once_t mm_epoch_thread_key_once = PTHREAD_ONCE_INIT;
+
+/*Latency instrumentation*/
+static vm_bool_t mm_lat_enabled = MM_FALSE;
+static double mm_lat_ns_per_tick = 1.0;
+static mm_thread_latency_t *mm_lat_threads = NULL; /*all slots, push only*/
+static pthread_key_t mm_lat_thread_key;
+static pthread_once_t mm_lat_thread_key_once = PTHREAD_ONCE_INIT;
+/*Histograms slot of a family is slot index + 1, process local : family
+	records of the shared and persistent heaps are not*/
+static vm_page_family_t *mm_lat_families[MM_LAT_MAX_FAMILIES];
+static uint32_t mm_lat_families_generation = 0;
+static pthread_mutex_t mm_lat_families_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread mm_thread_latency_t *mm_lat_self = NULL;
+static __thread mm_lat_cause_t mm_lat_cause;
+
+static inline uint64_t mm_lat_now()
 {
-	SYSTEM_PAGE_SIZE = getpagesize();
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
 
-	printf("Init: VM Page size = %lu\n\n", SYSTEM_PAGE_SIZE);
+/*Returns 0 when instrumentation is off, the start time otherwise*/
+static inline uint64_t mm_lat_begin()
+{
+	if (!mm_lat_enabled)
+		return 0;
+
+	mm_lat_cause = MM_LAT_FAST_PATH;
+	return mm_lat_now();
 }
 
-/*Return the size of Free Data block of an Empty VM Page*/
-static inline uint32_t mm_max_page_allocatable_memory(int units)
+/*Slow paths hit by the operation, the most expensive one is kept*/
+static inline void mm_lat_mark(mm_lat_cause_t cause)
 {
-	return (uint32_t)((SYSTEM_PAGE_SIZE * units) - offset_of(vm_page_t, page_memory));
+	if (cause > mm_lat_cause)
+		mm_lat_cause = cause;
 }
 
-#define MAX_PAGE_ALLOCATABLE_MEMORY(units) \
-	(mm_max_page_allocatable_memory(units))
+static inline uint32_t mm_lat_bucket(uint64_t ticks)
+{
+	if (ticks < MM_LAT_SUB_BUCKETS)
+		return (uint32_t)ticks;
 
-// Function to request vm page from kernel
-static void *mm_get_new_vm_page_from_kernel(int units)
+	uint32_t exponent = 63 - __builtin_clzll(ticks);
+	uint32_t sub_bucket = (ticks >> (exponent - MM_LAT_SUB_BUCKET_BITS)) & (MM_LAT_SUB_BUCKETS - 1);
+	uint32_t bucket = (exponent - MM_LAT_SUB_BUCKET_BITS + 1) * MM_LAT_SUB_BUCKETS + sub_bucket;
+
+	return bucket < MM_LAT_BUCKETS ? bucket : MM_LAT_BUCKETS - 1;
+}
+
+/*Largest duration falling in the bucket*/
+static uint64_t mm_lat_bucket_limit(uint32_t bucket)
 {
-	char *vm_page = mmap(
-		0,
-		units * SYSTEM_PAGE_SIZE,
-		PROT_READ | PROT_WRITE | PROT_EXEC,
-		MAP_ANON | MAP_PRIVATE,
-		0, 0);
+	if (bucket < MM_LAT_SUB_BUCKETS)
+		return bucket;
 
-	if (vm_page == MAP_FAILED)
-	{
-		printf("Error: VM Page allocation Failed\n");
-		return NULL;
-	}
+	uint32_t exponent = bucket / MM_LAT_SUB_BUCKETS + MM_LAT_SUB_BUCKET_BITS - 1;
+	uint64_t sub_bucket = bucket % MM_LAT_SUB_BUCKETS;
 
-	memset(vm_page, 0, units * SYSTEM_PAGE_SIZE);
+	return ((MM_LAT_SUB_BUCKETS + sub_bucket + 1) << (exponent - MM_LAT_SUB_BUCKET_BITS)) - 1;
+}
 
-	return (void *)vm_page;
+/*An exiting thread gives its slot up, counts included : they stay in
+	the totals and the next thread taking the slot adds to them. Slots
+	are so bounded by the number of threads alive at once*/
+static void mm_lat_thread_exit(void *arg)
+{
+	mm_thread_latency_t *self = arg;
+
+	__atomic_store_n(&self->in_use, 0, __ATOMIC_RELEASE);
 }
 
-static void mm_return_vm_page_to_kernel(void *vm_page, int units)
+static void mm_lat_thread_key_create()
 {
-	if (munmap(vm_page, units * SYSTEM_PAGE_SIZE))
-		printf("Error: Could not munmap VM page to kernel");
+	pthread_key_create(&mm_lat_thread_key, mm_lat_thread_exit);
 }
 
-void mm_instantiate_new_page_family(char *struct_name, uint32_t struct_size)
+static mm_thread_latency_t *mm_lat_thread_histograms()
 {
+	mm_thread_latency_t *self = NULL;
+	uint32_t in_use;
 
-	vm_page_family_t *vm_page_family_curr = NULL;
-	vm_page_for_families_t *new_vm_page_for_families = NULL;
+	if (mm_lat_self)
+		return mm_lat_self;
 
-	if (struct_size > SYSTEM_PAGE_SIZE)
-	{
+	pthread_once(&mm_lat_thread_key_once, mm_lat_thread_key_create);
 
-		printf("Error : %s() structure %s Size exceeds system page size\n", __FUNCTION__, struct_name);
-		return;
+	for (self = __atomic_load_n(&mm_lat_threads, __ATOMIC_ACQUIRE); self; self = self->next)
+	{
+		in_use = 0;
+		if (__atomic_compare_exchange_n(&self->in_use, &in_use, 1, MM_FALSE,
+										__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
 	}
 
-	if (!first_vm_page_for_families)
+	if (!self)
 	{
+		self = calloc(1, sizeof(mm_thread_latency_t));
+		if (!self)
+			return NULL;
 
-		first_vm_page_for_families = (vm_page_for_families_t *)mm_get_new_vm_page_from_kernel(1);
-		first_vm_page_for_families->next = NULL;
-		printf("First virtual memory page for families is created,\n");
+		self->in_use = 1;
+		self->next = __atomic_load_n(&mm_lat_threads, __ATOMIC_ACQUIRE);
+		while (!__atomic_compare_exchange_n(&mm_lat_threads, &self->next, self, MM_FALSE,
+											__ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			;
+	}
 
-		strncpy(first_vm_page_for_families->vm_page_family[0].struct_name, struct_name, MM_MAX_STRUCT_NAME);
-		first_vm_page_for_families->vm_page_family[0].struct_size = struct_size;
-		first_vm_page_for_families->vm_page_family[0].first_page = NULL;
-		printf("Virtual memory to %s is allocated\n", first_vm_page_for_families->vm_page_family[0].struct_name);
-		init_glthread(&first_vm_page_for_families->vm_page_family[0].free_block_priority_list_head);
-		return;
+	pthread_setspecific(mm_lat_thread_key, self);
+	mm_lat_self = self;
+	return self;
+}
+
+/*Family records are moved and reused once a family is unregistered, by
+	this process or by another one sharing the heap : the slots are given
+	out again and the per family histograms restart*/
+static void mm_lat_families_resync(uint32_t generation)
+{
+	mm_thread_latency_t *thread_lat = NULL;
+
+	pthread_mutex_lock(&mm_lat_families_mutex);
+	if (mm_lat_families_generation != generation)
+	{
+		memset(mm_lat_families, 0, sizeof(mm_lat_families));
+		for (thread_lat = __atomic_load_n(&mm_lat_threads, __ATOMIC_ACQUIRE);
+			 thread_lat; thread_lat = thread_lat->next)
+			memset(thread_lat->by_family, 0, sizeof(thread_lat->by_family));
+		__atomic_store_n(&mm_lat_families_generation, generation, __ATOMIC_RELEASE);
 	}
+	pthread_mutex_unlock(&mm_lat_families_mutex);
+}
 
-	uint32_t count = 0;
+/*Histograms slot of the family, taking a free one when assign is set.
+	0 : none, MM_LAT_MAX_FAMILIES + 1 is shared by the families past it*/
+static uint32_t mm_lat_family_slot(vm_page_family_t *pg_family, vm_bool_t assign)
+{
+	vm_page_family_t *family = NULL;
+	uint32_t generation = mm_page_family_generation();
+	uint32_t i;
 
-	ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
+	if (__atomic_load_n(&mm_lat_families_generation, __ATOMIC_ACQUIRE) != generation)
+		mm_lat_families_resync(generation);
+
+	for (i = 0; i < MM_LAT_MAX_FAMILIES; i++)
 	{
+		family = __atomic_load_n(&mm_lat_families[i], __ATOMIC_ACQUIRE);
 
-		if (strncmp(vm_page_family_curr->struct_name, struct_name, MM_MAX_STRUCT_NAME) != 0)
+		if (!family)
 		{
-			count++;
-			continue;
+			if (!assign)
+				return 0;
+			if (__atomic_compare_exchange_n(&mm_lat_families[i], &family, pg_family,
+											MM_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				return i + 1;
 		}
 
-		assert(0);
+		if (family == pg_family)
+			return i + 1;
 	}
-	ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_familiy_curr);
+	return MM_LAT_MAX_FAMILIES + 1;
+}
 
-	if (count == MAX_FAMILIES_PER_VM_PAGE)
-	{
+static void mm_lat_end(mm_lat_op_t op, vm_page_family_t *pg_family, uint64_t start)
+{
+	if (!start)
+		return;
 
-		new_vm_page_for_families = (vm_page_for_families_t *)mm_get_new_vm_page_from_kernel(1);
-		new_vm_page_for_families->next = first_vm_page_for_families;
-		first_vm_page_for_families = new_vm_page_for_families;
-		vm_page_family_curr = &first_vm_page_for_families->vm_page_family[0];
+	uint32_t bucket = mm_lat_bucket(mm_lat_now() - start);
+	mm_thread_latency_t *self = mm_lat_thread_histograms();
 
-		printf("Another virtual memory page for families is created,\n");
-	}
+	if (!self)
+		return;
 
-	strncpy(vm_page_family_curr->struct_name, struct_name, MM_MAX_STRUCT_NAME);
-	vm_page_family_curr->struct_size = struct_size;
-	vm_page_family_curr->first_page = NULL;
-	init_glthread(&vm_page_family_curr->free_block_priority_list_head);
-	printf("Virtual memory to %s is allocated\n", vm_page_family_curr->struct_name);
+	/*Only this thread writes its histograms, readers may see a count
+		late but never torn*/
+	__atomic_store_n(&self->by_cause[op][mm_lat_cause].count[bucket],
+					 self->by_cause[op][mm_lat_cause].count[bucket] + 1, __ATOMIC_RELAXED);
+
+	if (!pg_family)
+		return;
+
+	uint32_t stats_index = mm_lat_family_slot(pg_family, MM_TRUE);
+	mm_latency_histogram_t *histogram = &self->by_family[stats_index - 1][op];
+	__atomic_store_n(&histogram->count[bucket], histogram->count[bucket] + 1, __ATOMIC_RELAXED);
 }
 
-vm_bool_t mm_is_vm_page_empty(vm_page_t *vm_page)
+/*Default page provider : private anonymous mappings, not executable*/
+static void *mm_mmap_get_pages(void *ctx, size_t size)
+{
+	void *pages = mmap(0, size, PROT_READ | PROT_WRITE,
+					   MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	return pages == MAP_FAILED ? NULL : pages;
+}
+
+static void mm_mmap_return_pages(void *ctx, void *pages, size_t size)
+{
+	if (munmap(pages, size))
+		printf("Error: Could not munmap VM page to kernel");
+}
+
+static const mm_page_provider_t mm_mmap_page_provider = {
+	mm_mmap_get_pages,
+	mm_mmap_return_pages,
+	NULL};
+
+static mm_page_provider_t mm_page_provider;
+
+void mm_init_provider(const mm_page_provider_t *page_provider)
+{
+	SYSTEM_PAGE_SIZE = getpagesize();
+	mm_page_provider = page_provider ? *page_provider : mm_mmap_page_provider;
+
+	printf("Init: VM Page size = %lu\n\n", SYSTEM_PAGE_SIZE);
+}
+
+void mm_init()
+{
+	mm_init_provider(NULL);
+}
+
+/*Return the size of Free Data block of an Empty VM Page*/
+static inline uint32_t mm_max_page_allocatable_memory(int units)
+{
+	return (uint32_t)((SYSTEM_PAGE_SIZE * units) - offset_of(vm_page_t, page_memory));
+}
+
+#define MAX_PAGE_ALLOCATABLE_MEMORY(units) \
+	(mm_max_page_allocatable_memory(units))
+
+/*Serialize memory manager entry points in shared heap mode, the
+	families registry head is kept in the segment and refreshed
+	on every lock so that families registered by peers are seen*/
+static void mm_lock()
 {
-	if (vm_page->block_meta_data.next_block == NULL &&
-		vm_page->block_meta_data.prev_block == NULL &&
-		vm_page->block_meta_data.is_free == MM_TRUE)
+	if (mm_thread_safe)
+		pthread_mutex_lock(&mm_local_mutex);
+
+	if (!shared_heap)
+		return;
+
+	if (pthread_mutex_lock(&shared_heap->mutex) == EOWNERDEAD)
 	{
-		return MM_TRUE;
+		printf("Warning : process holding shared heap lock died\n");
+		pthread_mutex_consistent(&shared_heap->mutex);
 	}
-	return MM_FALSE;
+	first_vm_page_for_families = shared_heap->first_vm_page_for_families;
 }
 
-vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family)
+static void mm_unlock()
 {
-	vm_page_t *vm_page = mm_get_new_vm_page_from_kernel(1);
+	if (shared_heap)
+	{
+		shared_heap->first_vm_page_for_families = first_vm_page_for_families;
+		pthread_mutex_unlock(&shared_heap->mutex);
+	}
 
-	/*initailise lower most meta block of the VM page*/
-	MARK_VM_PAGE_EMPTY(vm_page);
+	if (mm_thread_safe)
+		pthread_mutex_unlock(&mm_local_mutex);
+}
 
-	vm_page->block_meta_data.block_size = MAX_PAGE_ALLOCATABLE_MEMORY(1);
-	vm_page->block_meta_data.offset = offset_of(vm_page_t, block_meta_data);
-	init_glthread(&vm_page->block_meta_data.priority_thread_glue);
-	vm_page->next = NULL;
-	vm_page->prev = NULL;
+/*Carve pages out of the shared segment, first fit over the runs
+	returned so far, then from the never used part of the segment*/
+static void *mm_shared_heap_get_pages(int units)
+{
+	mm_free_page_run_t *run = NULL;
+	mm_free_page_run_t **prev_next = &shared_heap->free_page_runs;
+	char *vm_page = NULL;
 
-	/*Set the back pointer to page family*/
-	vm_page->pg_family = vm_page_family;
+	for (run = shared_heap->free_page_runs; run; run = run->next)
+	{
+		if (run->units < units)
+		{
+			prev_next = &run->next;
+			continue;
+		}
 
-	/*if it is a first VM data page for a given
-		page family*/
-	if (!vm_page_family->first_page)
+		if (run->units == units)
+		{
+			*prev_next = run->next;
+			vm_page = (char *)run;
+		}
+		else
+		{
+			run->units -= units;
+			vm_page = (char *)run + (run->units * SYSTEM_PAGE_SIZE);
+		}
+		break;
+	}
+
+	if (!vm_page)
 	{
-		vm_page_family->first_page = vm_page;
-		return vm_page;
+		char *heap_end = (char *)shared_heap->base_address + shared_heap->heap_size;
+
+		if ((size_t)(heap_end - shared_heap->next_unused_page) < units * SYSTEM_PAGE_SIZE)
+		{
+			printf("Error: Shared heap exhausted\n");
+			return NULL;
+		}
+		vm_page = shared_heap->next_unused_page;
+		shared_heap->next_unused_page += units * SYSTEM_PAGE_SIZE;
 	}
 
-	/* install new VM page to the head of the linked list*/
-	vm_page->next = vm_page_family->first_page;
-	vm_page_family->first_page->prev = vm_page;
-	vm_page_family->first_page = vm_page;
-	return vm_page;
+	memset(vm_page, 0, units * SYSTEM_PAGE_SIZE);
+	return (void *)vm_page;
 }
 
-void mm_vm_page_delete_and_free(vm_page_t *vm_page)
+static void mm_shared_heap_return_pages(void *vm_page, int units)
 {
-	vm_page_family_t *vm_page_family = vm_page->pg_family;
+	mm_free_page_run_t *run = (mm_free_page_run_t *)vm_page;
 
-	/*if the page being deleted is the head of the linked list*/
-	if (vm_page_family->first_page == vm_page)
+	run->units = units;
+	run->next = shared_heap->free_page_runs;
+	shared_heap->free_page_runs = run;
+}
+
+// Function to request vm page from kernel
+static void *mm_get_new_vm_page_from_kernel(int units)
+{
+	if (shared_heap)
 	{
-		vm_page_family->first_page == vm_page->next;
-		if (vm_page->next)
-			vm_page->next->prev = NULL;
-		vm_page->next = NULL;
-		vm_page->prev = NULL;
-		mm_return_vm_page_to_kernel((void *)vm_page, 1);
-		return;
+		void *vm_page = mm_shared_heap_get_pages(units);
+		if (vm_page)
+			mm_budget.pages_in_use += units;
+		return vm_page;
 	}
 
-	/*if we are deleting the page from middle or end of
-		linked list*/
-	if (vm_page->next)
-		vm_page->next->prev = vm_page->prev;
-	vm_page->prev->next = vm_page->next;
-	mm_return_vm_page_to_kernel((void *)vm_page, 1);
+	char *vm_page = mm_page_provider.get_pages(mm_page_provider.ctx,
+											   units * SYSTEM_PAGE_SIZE);
+
+	if (!vm_page)
+	{
+		printf("Error: VM Page allocation Failed\n");
+		return NULL;
+	}
+
+	memset(vm_page, 0, units * SYSTEM_PAGE_SIZE);
+	mm_budget.pages_in_use += units;
+
+	return (void *)vm_page;
 }
 
-static int free_blocks_comparison_function(
-	void *_block_meta_data1,
-	void *_block_meta_data2)
+static void mm_return_vm_page_to_kernel(void *vm_page, int units)
 {
-	block_meta_data_t *block_meta_data1 = (block_meta_data_t *)_block_meta_data1;
+	mm_budget.pages_in_use -= units;
 
-	block_meta_data_t *block_meta_data2 = (block_meta_data_t *)_block_meta_data2;
+	if (shared_heap)
+	{
+		mm_shared_heap_return_pages(vm_page, units);
+		return;
+	}
 
-	if (block_meta_data1->block_size > block_meta_data2->block_size)
-		return -1;
-	else if (block_meta_data1->block_size < block_meta_data2->block_size)
-		return 1;
-	return 0;
+	mm_page_provider.return_pages(mm_page_provider.ctx, vm_page,
+								  units * SYSTEM_PAGE_SIZE);
 }
 
-static void mm_add_free_block_meta_data_to_free_block_list(
-	vm_page_family_t *vm_page_family,
-	block_meta_data_t *free_block)
+static void mm_shared_heap_mutex_init(mm_shared_heap_t *heap)
 {
+	pthread_mutexattr_t mutex_attr;
 
-	assert(free_block->is_free == MM_TRUE);
-	glthread_priority_insert(&vm_page_family->free_block_priority_list_head,
-							 &free_block->priority_thread_glue,
-							 free_blocks_comparison_function,
-							 offset_of(block_meta_data_t, priority_thread_glue));
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&heap->mutex, &mutex_attr);
+	pthread_mutexattr_destroy(&mutex_attr);
 }
 
-static vm_bool_t mm_split_free_data_block_for_allocation(
-	vm_page_family_t *vm_page_family,
-	block_meta_data_t *block_meta_data,
-	uint32_t size)
+static void mm_shared_heap_init(mm_shared_heap_t *heap, size_t heap_size,
+								uint32_t magic)
 {
+	heap->page_size = SYSTEM_PAGE_SIZE;
+	heap->base_address = (void *)heap;
+	heap->heap_size = heap_size;
+	/*Segment header occupies the first page of the segment*/
+	heap->next_unused_page = (char *)heap + SYSTEM_PAGE_SIZE;
+	heap->free_page_runs = NULL;
+	heap->first_vm_page_for_families = NULL;
+	heap->family_generation = 0;
+	heap->clean_shutdown = MM_FALSE;
+	heap->root_offset = 0;
+	mm_shared_heap_mutex_init(heap);
 
-	block_meta_data_t *next_block_meta_data = NULL;
+	/*Peers attaching to the segment check the magic last*/
+	__atomic_store_n(&heap->magic, magic, __ATOMIC_RELEASE);
+}
 
-	assert(block_meta_data->is_free == MM_TRUE);
+int mm_init_shared(char *shm_name, size_t heap_size)
+{
+	mm_shared_heap_t heap_header;
+	void *heap_base = NULL;
 
-	if (block_meta_data->block_size < size)
+	if (shared_heap)
 	{
-		return MM_FALSE;
+		printf("Error : %s() a heap is already open\n", __FUNCTION__);
+		return -1;
 	}
 
-	uint32_t remaining_size = block_meta_data->block_size - size;
+	mm_init();
 
-	block_meta_data->is_free = MM_FALSE;
-	block_meta_data->block_size = size;
-	remove_glthread(&block_meta_data->priority_thread_glue);
-	/*block_meta_data->offset = ??*/
-	/*case 1: No split*/
-	if (!remaining_size)
-	{
-		return MM_TRUE;
-	}
+	heap_size = (heap_size + SYSTEM_PAGE_SIZE - 1) & ~(SYSTEM_PAGE_SIZE - 1);
 
-	/*case 2: Partial split : soft internal fragmentation*/
-	else if (sizeof(block_meta_data_t) < remaining_size &&
-			 remaining_size < (sizeof(block_meta_data_t) + vm_page_family->struct_size))
+	int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (fd >= 0)
 	{
-		/*Now meta block is to be created*/
-		next_block_meta_data = NEXT_META_BLOCK_BY_SIZE(block_meta_data);
-		next_block_meta_data->is_free = MM_TRUE;
-		next_block_meta_data->block_size = remaining_size - sizeof(block_meta_data_t);
-		next_block_meta_data->offset = block_meta_data->offset + sizeof(block_meta_data_t) + block_meta_data->block_size;
-		init_glthread(&next_block_meta_data->priority_thread_glue);
-		mm_add_free_block_meta_data_to_free_block_list(
-			vm_page_family, next_block_meta_data);
-		mm_bind_blocks_for_allocation(block_meta_data, next_block_meta_data);
-	}
+		/*First process : size the segment and lay out the header*/
+		if (heap_size < 2 * SYSTEM_PAGE_SIZE || ftruncate(fd, heap_size))
+		{
+			printf("Error : %s() could not size shared heap %s\n", __FUNCTION__, shm_name);
+			close(fd);
+			shm_unlink(shm_name);
+			return -1;
+		}
 
-	/*case 3 : partial split : Hard internal fragmentation*/
-	else if (remaining_size < sizeof(block_meta_data_t))
+		heap_base = mmap(0, heap_size, PROT_READ | PROT_WRITE,
+						 MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (heap_base == MAP_FAILED)
+		{
+			printf("Error : %s() could not map shared heap %s\n", __FUNCTION__, shm_name);
+			shm_unlink(shm_name);
+			return -1;
+		}
+
+		mm_shared_heap_init((mm_shared_heap_t *)heap_base, heap_size,
+							MM_SHARED_HEAP_MAGIC);
+		printf("Shared heap %s created at %p, size = %zu\n", shm_name, heap_base, heap_size);
+	}
+	else
 	{
-		/*No need to do anythin !!*/
+		/*Segment exists : map it at the address it was created at*/
+		fd = errno == EEXIST ? shm_open(shm_name, O_RDWR, 0) : -1;
+
+		if (fd < 0 ||
+			pread(fd, &heap_header, sizeof(heap_header), 0) != sizeof(heap_header) ||
+			heap_header.magic != MM_SHARED_HEAP_MAGIC ||
+			heap_header.page_size != SYSTEM_PAGE_SIZE)
+		{
+			printf("Error : %s() shared heap %s is not initialized\n", __FUNCTION__, shm_name);
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+
+		heap_base = mmap(heap_header.base_address, heap_header.heap_size,
+						 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+		close(fd);
+
+		if (heap_base != heap_header.base_address)
+		{
+			printf("Error : %s() could not map shared heap %s at %p\n",
+				   __FUNCTION__, shm_name, heap_header.base_address);
+			if (heap_base != MAP_FAILED)
+				munmap(heap_base, heap_header.heap_size);
+			return -1;
+		}
+		printf("Shared heap %s attached at %p\n", shm_name, heap_base);
+	}
+
+	shared_heap = (mm_shared_heap_t *)heap_base;
+	first_vm_page_for_families = shared_heap->first_vm_page_for_families;
+	return 0;
+}
+
+/*Persistent heap reopened at another address : every pointer kept by
+	the memory manager is moved by delta. Pointers are checked against
+	the bounds the heap had when it was written and the number of links
+	followed is bounded, so a damaged heap is rejected, not followed*/
+typedef struct mm_heap_relocation_
+{
+	char *old_base;
+	char *old_end;
+	ptrdiff_t delta;
+	size_t steps_left;
+	vm_bool_t ok;
+} mm_heap_relocation_t;
+
+static void *mm_relocate_ptr(mm_heap_relocation_t *reloc, void *ptr)
+{
+	if (!ptr || !reloc->ok)
+		return NULL;
+
+	if ((char *)ptr < reloc->old_base || (char *)ptr >= reloc->old_end ||
+		!reloc->steps_left--)
+	{
+		reloc->ok = MM_FALSE;
+		return NULL;
+	}
+	return (char *)ptr + reloc->delta;
+}
+
+#define MM_RELOCATE(reloc, field) \
+	((field) = mm_relocate_ptr(reloc, (field)))
+
+static void mm_relocate_glthread(mm_heap_relocation_t *reloc, glthread_t *glthread)
+{
+	MM_RELOCATE(reloc, glthread->left);
+	MM_RELOCATE(reloc, glthread->right);
+}
+
+static void mm_relocate_vm_page(mm_heap_relocation_t *reloc, vm_page_t *vm_page)
+{
+	block_meta_data_t *block_meta_data = NULL;
+
+	MM_RELOCATE(reloc, vm_page->next);
+	MM_RELOCATE(reloc, vm_page->prev);
+	MM_RELOCATE(reloc, vm_page->pg_family);
+
+	for (block_meta_data = &vm_page->block_meta_data; block_meta_data && reloc->ok;
+		 block_meta_data = block_meta_data->next_block)
+	{
+		MM_RELOCATE(reloc, block_meta_data->prev_block);
+		MM_RELOCATE(reloc, block_meta_data->next_block);
+		mm_relocate_glthread(reloc, &block_meta_data->priority_thread_glue);
+	}
+}
+
+/*Page directory, or object directory of a relocatable family*/
+static void mm_relocate_directory(mm_heap_relocation_t *reloc,
+								  mm_page_directory_t **directory_ptr)
+{
+	mm_page_directory_t *directory = NULL;
+	uint32_t page_index;
+
+	MM_RELOCATE(reloc, *directory_ptr);
+
+	for (directory = *directory_ptr; directory && reloc->ok;
+		 directory = directory->retired)
+	{
+		if (directory->used > directory->capacity ||
+			(char *)&directory->entries[directory->capacity] > reloc->old_end + reloc->delta)
+		{
+			reloc->ok = MM_FALSE;
+			return;
+		}
+
+		for (page_index = 0; page_index < directory->used; page_index++)
+		{
+			if (!(directory->entries[page_index] & 1))
+				directory->entries[page_index] = (uintptr_t)mm_relocate_ptr(
+					reloc, (void *)directory->entries[page_index]);
+		}
+		MM_RELOCATE(reloc, directory->retired);
+	}
+}
+
+static vm_bool_t mm_persistent_heap_relocate(mm_shared_heap_t *heap)
+{
+	mm_heap_relocation_t reloc;
+	mm_free_page_run_t *run = NULL;
+	vm_page_for_families_t *vm_page_for_families = NULL;
+	vm_page_family_t *vm_page_family = NULL;
+	vm_page_t *vm_page = NULL;
+
+	reloc.old_base = (char *)heap->base_address;
+	reloc.old_end = reloc.old_base + heap->heap_size;
+	reloc.delta = (char *)heap - reloc.old_base;
+	reloc.steps_left = heap->heap_size / sizeof(void *);
+	reloc.ok = MM_TRUE;
+
+	/*May point right past the end of a full heap*/
+	if (heap->next_unused_page < reloc.old_base + SYSTEM_PAGE_SIZE ||
+		heap->next_unused_page > reloc.old_end)
+		return MM_FALSE;
+	heap->next_unused_page += reloc.delta;
+
+	MM_RELOCATE(&reloc, heap->free_page_runs);
+	for (run = heap->free_page_runs; run && reloc.ok; run = run->next)
+		MM_RELOCATE(&reloc, run->next);
+
+	MM_RELOCATE(&reloc, heap->first_vm_page_for_families);
+	for (vm_page_for_families = heap->first_vm_page_for_families;
+		 vm_page_for_families && reloc.ok;
+		 vm_page_for_families = vm_page_for_families->next)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families, vm_page_family)
+		{
+			MM_RELOCATE(&reloc, vm_page_family->first_page);
+			mm_relocate_directory(&reloc, &vm_page_family->page_directory);
+			mm_relocate_directory(&reloc, &vm_page_family->object_directory);
+			mm_relocate_glthread(&reloc, &vm_page_family->free_block_priority_list_head);
+			mm_relocate_glthread(&reloc, &vm_page_family->deferred_free_list_head);
+			MM_RELOCATE(&reloc, vm_page_family->bump_page);
+			MM_RELOCATE(&reloc, vm_page_family->bump_last);
+			MM_RELOCATE(&reloc, vm_page_family->bump_ptr);
+
+			for (vm_page = vm_page_family->first_page; vm_page && reloc.ok;
+				 vm_page = vm_page->next)
+				mm_relocate_vm_page(&reloc, vm_page);
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families, vm_page_family);
+
+		MM_RELOCATE(&reloc, vm_page_for_families->next);
+	}
+
+	heap->base_address = (void *)heap;
+	return reloc.ok;
+}
+
+/*Structural check of a persistent heap which was not shut down
+	cleanly, run once all its pointers are known to be in bounds*/
+static vm_bool_t mm_persistent_heap_check(mm_shared_heap_t *heap)
+{
+	mm_free_page_run_t *run = NULL;
+	vm_page_for_families_t *vm_page_for_families = NULL;
+	vm_page_family_t *vm_page_family = NULL;
+	vm_page_t *vm_page = NULL;
+	block_meta_data_t *block_meta_data = NULL;
+	char *heap_end = (char *)heap + heap->heap_size;
+
+	for (run = heap->free_page_runs; run; run = run->next)
+	{
+		if (((char *)run - (char *)heap) % SYSTEM_PAGE_SIZE || !run->units ||
+			(char *)run + (size_t)run->units * SYSTEM_PAGE_SIZE > heap->next_unused_page)
+			return MM_FALSE;
+	}
+
+	for (vm_page_for_families = heap->first_vm_page_for_families;
+		 vm_page_for_families;
+		 vm_page_for_families = vm_page_for_families->next)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families, vm_page_family)
+		{
+			uint32_t free_blocks = 0;
+			vm_page_t *prev_page = NULL;
+
+			for (vm_page = vm_page_family->first_page; vm_page;
+				 prev_page = vm_page, vm_page = vm_page->next)
+			{
+				char *page_end = (char *)vm_page +
+								 vm_page_family->span_pages * SYSTEM_PAGE_SIZE;
+				block_meta_data_t *prev_block = NULL;
+
+				if (((char *)vm_page - (char *)heap) % SYSTEM_PAGE_SIZE ||
+					page_end > heap_end ||
+					vm_page->pg_family != vm_page_family ||
+					vm_page->prev != prev_page ||
+					vm_page->page_index >= vm_page_family->page_directory->used ||
+					vm_page_family->page_directory->entries[vm_page->page_index] !=
+						(uintptr_t)vm_page)
+					return MM_FALSE;
+
+				for (block_meta_data = &vm_page->block_meta_data; block_meta_data;
+					 prev_block = block_meta_data, block_meta_data = block_meta_data->next_block)
+				{
+					if (block_meta_data->prev_block != prev_block ||
+						block_meta_data->offset != (char *)block_meta_data - (char *)vm_page ||
+						(char *)NEXT_META_BLOCK_BY_SIZE(block_meta_data) > page_end ||
+						(block_meta_data->next_block &&
+						 block_meta_data->next_block < NEXT_META_BLOCK_BY_SIZE(block_meta_data)))
+						return MM_FALSE;
+
+					if (block_meta_data->is_free && !block_meta_data->is_deferred)
+						free_blocks++;
+				}
+			}
+
+			if (get_glthread_list_count(&vm_page_family->free_block_priority_list_head) != free_blocks ||
+				get_glthread_list_count(&vm_page_family->deferred_free_list_head) !=
+					vm_page_family->deferred_count)
+				return MM_FALSE;
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families, vm_page_family);
+	}
+
+	return MM_TRUE;
+}
+
+int mm_init_persistent(char *path, size_t heap_size)
+{
+	mm_shared_heap_t heap_header;
+	mm_shared_heap_t *heap = NULL;
+	struct stat file_stat;
+
+	if (shared_heap)
+	{
+		printf("Error : %s() a heap is already open\n", __FUNCTION__);
+		return -1;
+	}
+
+	mm_init();
+
+	heap_size = (heap_size + SYSTEM_PAGE_SIZE - 1) & ~(SYSTEM_PAGE_SIZE - 1);
+
+	int fd = open(path, O_RDWR | O_CREAT, 0600);
+
+	if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) || fstat(fd, &file_stat))
+	{
+		printf("Error : %s() could not open persistent heap %s\n", __FUNCTION__, path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	if (file_stat.st_size == 0)
+	{
+		/*New file : size it and lay out the header*/
+		if (heap_size < 2 * SYSTEM_PAGE_SIZE || ftruncate(fd, heap_size))
+		{
+			printf("Error : %s() could not size persistent heap %s\n", __FUNCTION__, path);
+			close(fd);
+			return -1;
+		}
+
+		heap = mmap(0, heap_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+		if (heap == MAP_FAILED)
+		{
+			printf("Error : %s() could not map persistent heap %s\n", __FUNCTION__, path);
+			close(fd);
+			return -1;
+		}
+
+		mm_shared_heap_init(heap, heap_size, MM_PERSISTENT_HEAP_MAGIC);
+		printf("Persistent heap %s created at %p, size = %zu\n", path, heap, heap_size);
+	}
+	else
+	{
+		if (pread(fd, &heap_header, sizeof(heap_header), 0) != sizeof(heap_header) ||
+			heap_header.magic != MM_PERSISTENT_HEAP_MAGIC ||
+			heap_header.page_size != SYSTEM_PAGE_SIZE ||
+			heap_header.heap_size != (size_t)file_stat.st_size)
+		{
+			printf("Error : %s() %s is not a persistent heap\n", __FUNCTION__, path);
+			close(fd);
+			return -1;
+		}
+
+		/*Prefer the address the heap was written at, nothing to relocate then*/
+		heap = mmap(heap_header.base_address, heap_header.heap_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+
+		if (heap == MAP_FAILED)
+			heap = mmap(0, heap_header.heap_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+		if (heap == MAP_FAILED)
+		{
+			printf("Error : %s() could not map persistent heap %s\n", __FUNCTION__, path);
+			close(fd);
+			return -1;
+		}
+
+		if (!heap->clean_shutdown)
+			printf("Warning : persistent heap %s was not shut down cleanly, checking it\n", path);
+
+		/*A relocation pass with a zero delta still bounds checks every pointer*/
+		if (((heap->base_address != (void *)heap || !heap->clean_shutdown) &&
+			 !mm_persistent_heap_relocate(heap)) ||
+			(!heap->clean_shutdown && !mm_persistent_heap_check(heap)))
+		{
+			printf("Error : %s() persistent heap %s is corrupted\n", __FUNCTION__, path);
+			munmap(heap, heap_header.heap_size);
+			close(fd);
+			return -1;
+		}
+
+		/*The last process may have died holding the lock, family
+			handles cached before the heap moved must be re-bound*/
+		mm_shared_heap_mutex_init(heap);
+		heap->family_generation++;
+		printf("Persistent heap %s opened at %p\n", path, heap);
+	}
+
+	/*Pages handed out, less the header page and the returned runs*/
+	mm_free_page_run_t *run = NULL;
+	mm_budget.pages_in_use = (heap->next_unused_page - (char *)heap) / SYSTEM_PAGE_SIZE - 1;
+	for (run = heap->free_page_runs; run; run = run->next)
+		mm_budget.pages_in_use -= run->units;
+
+	/*Cleared again by mm_close_persistent()*/
+	heap->clean_shutdown = MM_FALSE;
+	msync(heap, SYSTEM_PAGE_SIZE, MS_SYNC);
+
+	mm_persistent_fd = fd;
+	shared_heap = heap;
+	first_vm_page_for_families = shared_heap->first_vm_page_for_families;
+	return 0;
+}
+
+void mm_close_persistent()
+{
+	mm_shared_heap_t *heap = shared_heap;
+
+	if (!heap || heap->magic != MM_PERSISTENT_HEAP_MAGIC)
+		return;
+
+	mm_lock();
+	heap->clean_shutdown = MM_TRUE;
+	mm_unlock();
+
+	msync(heap, heap->heap_size, MS_SYNC);
+	munmap(heap, heap->heap_size);
+	close(mm_persistent_fd);
+
+	mm_persistent_fd = -1;
+	shared_heap = NULL;
+	first_vm_page_for_families = NULL;
+	mm_budget.pages_in_use = 0;
+	page_family_generation++;
+}
+
+size_t mm_heap_offset(void *ptr)
+{
+	if (!ptr || !shared_heap)
+		return 0;
+	return (char *)ptr - (char *)shared_heap;
+}
+
+void *mm_heap_ptr(size_t offset)
+{
+	if (!offset || !shared_heap)
+		return NULL;
+	return (char *)shared_heap + offset;
+}
+
+void mm_set_heap_root(void *ptr)
+{
+	if (shared_heap)
+		shared_heap->root_offset = mm_heap_offset(ptr);
+}
+
+void *mm_heap_root()
+{
+	if (!shared_heap)
+		return NULL;
+	return mm_heap_ptr(shared_heap->root_offset);
+}
+
+/*Span of a family : VM data pages of 1 system page hold one 2.1K
+	structure and waste almost half of it, spans of 4 hold seven. Pick
+	the smallest span whose memory per object is within
+	1/MM_SPAN_WASTE_TOLERANCE of the best, 4 for 2.1K*/
+static uint32_t mm_family_span_pages(uint32_t struct_size)
+{
+	uint32_t slot_size = struct_size + sizeof(block_meta_data_t);
+	uint64_t bytes_per_object[MM_MAX_SPAN_PAGES + 1];
+	uint64_t best = UINT64_MAX;
+	uint32_t units;
+
+	for (units = 1; units <= MM_MAX_SPAN_PAGES; units++)
+	{
+		/*The first block meta data is part of the page header*/
+		uint32_t objects = (MAX_PAGE_ALLOCATABLE_MEMORY(units) +
+							sizeof(block_meta_data_t)) / slot_size;
+
+		bytes_per_object[units] = objects ? units * SYSTEM_PAGE_SIZE / objects : UINT64_MAX;
+		if (bytes_per_object[units] < best)
+			best = bytes_per_object[units];
+	}
+
+	for (units = 1; units < MM_MAX_SPAN_PAGES; units++)
+	{
+		if (bytes_per_object[units] <= best + best / MM_SPAN_WASTE_TOLERANCE)
+			break;
+	}
+	return units;
+}
+
+static void mm_family_set_span(vm_page_family_t *vm_page_family, uint32_t span_pages)
+{
+	vm_page_family->span_pages = span_pages;
+	vm_page_family->handle_offset_bits =
+		__builtin_ctzll(SYSTEM_PAGE_SIZE) + (32 - __builtin_clz(span_pages) - 1) +
+		((span_pages & (span_pages - 1)) ? 1 : 0);
+}
+
+void mm_instantiate_new_page_family(char *struct_name, uint32_t struct_size)
+{
+
+	vm_page_family_t *vm_page_family_curr = NULL;
+	vm_page_for_families_t *new_vm_page_for_families = NULL;
+
+	if (struct_size > MAX_PAGE_ALLOCATABLE_MEMORY(MM_MAX_SPAN_PAGES))
+	{
+
+		printf("Error : %s() structure %s Size exceeds maximum span size\n", __FUNCTION__, struct_name);
+		return;
+	}
+
+	uint32_t span_pages = mm_family_span_pages(struct_size);
+
+	mm_lock();
+
+	if (!first_vm_page_for_families)
+	{
+
+		first_vm_page_for_families = (vm_page_for_families_t *)mm_get_new_vm_page_from_kernel(1);
+		first_vm_page_for_families->next = NULL;
+		printf("First virtual memory page for families is created,\n");
+
+		strncpy(first_vm_page_for_families->vm_page_family[0].struct_name, struct_name, MM_MAX_STRUCT_NAME);
+		first_vm_page_for_families->vm_page_family[0].struct_size = struct_size;
+		first_vm_page_for_families->vm_page_family[0].first_page = NULL;
+		mm_family_set_span(&first_vm_page_for_families->vm_page_family[0], span_pages);
+		printf("Virtual memory to %s is allocated\n", first_vm_page_for_families->vm_page_family[0].struct_name);
+		init_glthread(&first_vm_page_for_families->vm_page_family[0].free_block_priority_list_head);
+		init_glthread(&first_vm_page_for_families->vm_page_family[0].deferred_free_list_head);
+		MM_PROBE3(family_register, struct_name, struct_size, span_pages);
+		mm_unlock();
+		return;
+	}
+
+	uint32_t count = 0;
+
+	ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
+	{
+
+		if (strncmp(vm_page_family_curr->struct_name, struct_name, MM_MAX_STRUCT_NAME) != 0)
+		{
+			count++;
+			continue;
+		}
+
+		/*In shared heap mode every process registers its structures,
+			the first one to do so creates the family*/
+		if (shared_heap && vm_page_family_curr->struct_size == struct_size)
+		{
+			mm_unlock();
+			return;
+		}
+
+		assert(0);
+	}
+	ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_familiy_curr);
+
+	if (count == MAX_FAMILIES_PER_VM_PAGE)
+	{
+
+		new_vm_page_for_families = (vm_page_for_families_t *)mm_get_new_vm_page_from_kernel(1);
+		new_vm_page_for_families->next = first_vm_page_for_families;
+		first_vm_page_for_families = new_vm_page_for_families;
+		vm_page_family_curr = &first_vm_page_for_families->vm_page_family[0];
+
+		printf("Another virtual memory page for families is created,\n");
+	}
+
+	strncpy(vm_page_family_curr->struct_name, struct_name, MM_MAX_STRUCT_NAME);
+	vm_page_family_curr->struct_size = struct_size;
+	vm_page_family_curr->first_page = NULL;
+	mm_family_set_span(vm_page_family_curr, span_pages);
+	init_glthread(&vm_page_family_curr->free_block_priority_list_head);
+	init_glthread(&vm_page_family_curr->deferred_free_list_head);
+	printf("Virtual memory to %s is allocated\n", vm_page_family_curr->struct_name);
+	/*probe mm:family_register(struct_name, struct_size, span_pages)*/
+	MM_PROBE3(family_register, struct_name, struct_size, span_pages);
+	mm_unlock();
+}
+
+vm_bool_t mm_is_vm_page_empty(vm_page_t *vm_page)
+{
+	block_meta_data_t *first_block = mm_vm_page_first_data_block(vm_page);
+
+	if (first_block->next_block == NULL &&
+		first_block->is_free == MM_TRUE)
+	{
+		return MM_TRUE;
+	}
+	return MM_FALSE;
+}
+
+/*Check that one more page of units pages fits in the global and
+	family budgets, giving the pressure callback one chance to release
+	memory when it does not*/
+static vm_bool_t mm_budget_admit(vm_page_family_t *vm_page_family, int units)
+{
+	int attempt;
+
+	for (attempt = 0; attempt < 2; attempt++)
+	{
+		vm_bool_t global_ok = !mm_budget.hard_limit_pages ||
+							  mm_budget.pages_in_use + units <= mm_budget.hard_limit_pages;
+		vm_bool_t family_ok = !vm_page_family || !vm_page_family->max_pages ||
+							  vm_page_family->page_count + units <= vm_page_family->max_pages;
+
+		if (global_ok && family_ok)
+			return MM_TRUE;
+
+		if (attempt || !mm_budget.pressure_cb)
+			break;
+
+		mm_budget.pressure_cb(vm_page_family ? vm_page_family->struct_name : NULL,
+							  units * SYSTEM_PAGE_SIZE);
+	}
+
+	printf("Error : Memory budget exceeded for %s\n",
+		   vm_page_family ? vm_page_family->struct_name : "arena/xmalloc/internal pages");
+	return MM_FALSE;
+}
+
+/*Take a page retained for reuse, accounted as in use again*/
+static void *mm_take_retained_page()
+{
+	vm_page_t *vm_page = mm_budget.retained_pages;
+
+	if (!vm_page)
+		return NULL;
+
+	mm_budget.retained_pages = vm_page->next;
+	mm_budget.pages_retained--;
+	mm_budget.pages_in_use++;
+
+	/*Content is undefined after MADV_FREE*/
+	memset(vm_page, 0, SYSTEM_PAGE_SIZE);
+	return vm_page;
+}
+
+/*Keep an empty page mapped for reuse while below the soft limit,
+	letting the kernel reclaim it lazily, else return it right away*/
+static void mm_retain_or_return_page(vm_page_t *vm_page, uint32_t span_pages)
+{
+	if (shared_heap || span_pages != 1 ||
+		mm_budget.pages_in_use + mm_budget.pages_retained > mm_budget.soft_limit_pages)
+	{
+		mm_return_vm_page_to_kernel((void *)vm_page, span_pages);
+		return;
+	}
+
+#ifdef MADV_FREE
+	madvise(vm_page, SYSTEM_PAGE_SIZE, MADV_FREE);
+#else
+	madvise(vm_page, SYSTEM_PAGE_SIZE, MADV_DONTNEED);
+#endif
+	vm_page->next = mm_budget.retained_pages;
+	mm_budget.retained_pages = vm_page;
+	mm_budget.pages_in_use--;
+	mm_budget.pages_retained++;
+}
+
+/*Store entry in a free slot of the directory at *directory_ptr, grown
+	up to max_capacity entries, and return its index in *index*/
+static vm_bool_t mm_directory_insert(mm_page_directory_t **directory_ptr,
+									 uint32_t max_capacity, uintptr_t entry,
+									 uint32_t *index)
+{
+	mm_page_directory_t *directory = *directory_ptr;
+
+	if (directory && directory->free_index)
+	{
+		*index = directory->free_index - 1;
+		directory->free_index = directory->entries[*index] >> 1;
+		__atomic_store_n(&directory->entries[*index], entry, __ATOMIC_RELEASE);
+		return MM_TRUE;
+	}
+
+	if (!directory || directory->used == directory->capacity)
+	{
+		uint32_t capacity = directory ? directory->capacity * 2 : 0;
+
+		if (directory && directory->capacity == max_capacity)
+			return MM_FALSE;
+
+		if (capacity > max_capacity)
+			capacity = max_capacity;
+
+		int units = (offset_of(mm_page_directory_t, entries) +
+					 capacity * sizeof(uintptr_t) + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+
+		if (!units)
+			units = 1;
+
+		mm_page_directory_t *new_directory =
+			mm_budget_admit(NULL, units) ? mm_get_new_vm_page_from_kernel(units) : NULL;
+
+		if (!new_directory)
+			return MM_FALSE;
+
+		new_directory->units = units;
+		new_directory->capacity = (units * SYSTEM_PAGE_SIZE -
+								   offset_of(mm_page_directory_t, entries)) / sizeof(uintptr_t);
+		if (new_directory->capacity > max_capacity)
+			new_directory->capacity = max_capacity;
+
+		if (directory)
+		{
+			memcpy(new_directory->entries, directory->entries,
+				   directory->used * sizeof(uintptr_t));
+			new_directory->used = directory->used;
+			new_directory->free_index = directory->free_index;
+		}
+		new_directory->retired = directory;
+
+		__atomic_store_n(directory_ptr, new_directory, __ATOMIC_RELEASE);
+		directory = new_directory;
+	}
+
+	*index = directory->used++;
+	__atomic_store_n(&directory->entries[*index], entry, __ATOMIC_RELEASE);
+	return MM_TRUE;
+}
+
+static void mm_directory_remove(mm_page_directory_t *directory, uint32_t index)
+{
+	directory->entries[index] = MM_PAGE_DIRECTORY_FREE_ENTRY(directory->free_index);
+	directory->free_index = index + 1;
+}
+
+static void mm_directory_release(mm_page_directory_t **directory_ptr)
+{
+	mm_page_directory_t *directory = *directory_ptr;
+	mm_page_directory_t *retired = NULL;
+
+	for (; directory; directory = retired)
+	{
+		retired = directory->retired;
+		mm_return_vm_page_to_kernel((void *)directory, directory->units);
+	}
+	*directory_ptr = NULL;
+}
+
+static vm_bool_t mm_page_directory_insert(vm_page_family_t *vm_page_family,
+										  vm_page_t *vm_page)
+{
+	if (mm_directory_insert(&vm_page_family->page_directory,
+							1u << (32 - vm_page_family->handle_offset_bits),
+							(uintptr_t)vm_page, &vm_page->page_index))
+		return MM_TRUE;
+
+	printf("Error : %s() page directory of %s is full\n",
+		   __FUNCTION__, vm_page_family->struct_name);
+	return MM_FALSE;
+}
+
+static void mm_page_directory_remove(vm_page_family_t *vm_page_family,
+									 vm_page_t *vm_page)
+{
+	mm_directory_remove(vm_page_family->page_directory, vm_page->page_index);
+}
+
+static void mm_page_directory_release(vm_page_family_t *vm_page_family)
+{
+	mm_directory_release(&vm_page_family->page_directory);
+}
+
+/*Pages of a family take turns starting their data at every cache line
+	multiple up to the bytes a page full of single objects leaves unused,
+	so that same index objects of different pages use different cache
+	sets. The page still holds as many objects*/
+static uint32_t mm_family_max_color(vm_page_family_t *vm_page_family)
+{
+	uint32_t slot_size = vm_page_family->struct_size + sizeof(block_meta_data_t);
+	uint32_t slack = (MAX_PAGE_ALLOCATABLE_MEMORY(vm_page_family->span_pages) +
+					  sizeof(block_meta_data_t)) % slot_size;
+
+	return slack - slack % MM_CACHE_LINE_SIZE;
+}
+
+/*A colored page has its first block shorter by the color, the largest
+	request is the one every page can serve*/
+static uint32_t mm_family_max_request(vm_page_family_t *vm_page_family)
+{
+	return MAX_PAGE_ALLOCATABLE_MEMORY(vm_page_family->span_pages) -
+		   mm_family_max_color(vm_page_family);
+}
+
+static uint32_t mm_family_next_color(vm_page_family_t *vm_page_family)
+{
+	uint32_t color = vm_page_family->next_color;
+
+	if (color > mm_family_max_color(vm_page_family))
+		color = 0;
+
+	vm_page_family->next_color = color + MM_CACHE_LINE_SIZE;
+	return color;
+}
+
+vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family)
+{
+	uint32_t span_pages = vm_page_family->span_pages;
+	vm_page_t *vm_page = NULL;
+
+	if (!mm_budget_admit(vm_page_family, span_pages))
+		return NULL;
+
+	/*Retained pages are single system pages*/
+	if (span_pages == 1)
+		vm_page = mm_take_retained_page();
+
+	if (!vm_page)
+		vm_page = mm_get_new_vm_page_from_kernel(span_pages);
+
+	if (!vm_page)
+		return NULL;
+
+	if (!mm_page_directory_insert(vm_page_family, vm_page))
+	{
+		mm_return_vm_page_to_kernel((void *)vm_page, span_pages);
+		return NULL;
+	}
+
+	vm_page_family->page_count += span_pages;
+
+	/*initailise lower most meta block of the VM page*/
+	MARK_VM_PAGE_EMPTY(vm_page);
+
+	vm_page->block_meta_data.block_size = MAX_PAGE_ALLOCATABLE_MEMORY(span_pages);
+	vm_page->block_meta_data.offset = offset_of(vm_page_t, block_meta_data);
+	init_glthread(&vm_page->block_meta_data.priority_thread_glue);
+	vm_page->next = NULL;
+	vm_page->prev = NULL;
+
+	/*The lower most meta block becomes an allocated pad of color bytes,
+		it is never freed and never merged with*/
+	vm_page->color = mm_family_next_color(vm_page_family);
+
+	if (vm_page->color)
+	{
+		block_meta_data_t *first_block = (block_meta_data_t *)(vm_page->page_memory +
+			vm_page->color - sizeof(block_meta_data_t));
+
+		vm_page->block_meta_data.is_free = MM_FALSE;
+		vm_page->block_meta_data.block_size = vm_page->color - sizeof(block_meta_data_t);
+
+		first_block->is_free = MM_TRUE;
+		first_block->is_deferred = MM_FALSE;
+		first_block->block_size = MAX_PAGE_ALLOCATABLE_MEMORY(span_pages) - vm_page->color;
+		first_block->offset = vm_page->block_meta_data.offset + vm_page->color;
+		init_glthread(&first_block->priority_thread_glue);
+		first_block->next_block = NULL;
+		mm_bind_blocks_for_allocation((&vm_page->block_meta_data), first_block);
+	}
+
+	/*Set the back pointer to page family*/
+	vm_page->pg_family = vm_page_family;
+
+	/*probe mm:page_alloc(struct_name, vm_page, bytes)*/
+	MM_PROBE3(page_alloc, vm_page_family->struct_name, vm_page,
+			  (size_t)span_pages * SYSTEM_PAGE_SIZE);
+
+	/*if it is a first VM data page for a given
+		page family*/
+	if (!vm_page_family->first_page)
+	{
+		vm_page_family->first_page = vm_page;
+		return vm_page;
+	}
+
+	/* install new VM page to the head of the linked list*/
+	vm_page->next = vm_page_family->first_page;
+	vm_page_family->first_page->prev = vm_page;
+	vm_page_family->first_page = vm_page;
+	return vm_page;
+}
+
+void mm_vm_page_delete_and_free(vm_page_t *vm_page)
+{
+	vm_page_family_t *vm_page_family = vm_page->pg_family;
+
+	mm_lat_mark(MM_LAT_PAGE_FREE);
+	if (vm_page_family->bump_page == vm_page)
+	{
+		vm_page_family->bump_page = NULL;
+		vm_page_family->bump_last = NULL;
+		vm_page_family->bump_ptr = NULL;
+	}
+	/*probe mm:page_free(struct_name, vm_page, bytes)*/
+	MM_PROBE3(page_free, vm_page_family->struct_name, vm_page,
+			  (size_t)vm_page_family->span_pages * SYSTEM_PAGE_SIZE);
+	mm_page_directory_remove(vm_page_family, vm_page);
+
+	/*if the page being deleted is the head of the linked list*/
+	if (vm_page_family->first_page == vm_page)
+	{
+		vm_page_family->first_page = vm_page->next;
+		if (vm_page->next)
+			vm_page->next->prev = NULL;
+		vm_page->next = NULL;
+		vm_page->prev = NULL;
+		vm_page_family->page_count -= vm_page_family->span_pages;
+		mm_retain_or_return_page(vm_page, vm_page_family->span_pages);
+		return;
+	}
+
+	/*if we are deleting the page from middle or end of
+		linked list*/
+	if (vm_page->next)
+		vm_page->next->prev = vm_page->prev;
+	vm_page->prev->next = vm_page->next;
+	vm_page_family->page_count -= vm_page_family->span_pages;
+	mm_retain_or_return_page(vm_page, vm_page_family->span_pages);
+}
+
+static int free_blocks_comparison_function(
+	void *_block_meta_data1,
+	void *_block_meta_data2)
+{
+	block_meta_data_t *block_meta_data1 = (block_meta_data_t *)_block_meta_data1;
+
+	block_meta_data_t *block_meta_data2 = (block_meta_data_t *)_block_meta_data2;
+
+	if (block_meta_data1->block_size > block_meta_data2->block_size)
+		return -1;
+	else if (block_meta_data1->block_size < block_meta_data2->block_size)
+		return 1;
+	return 0;
+}
+
+static void mm_add_free_block_meta_data_to_free_block_list(
+	vm_page_family_t *vm_page_family,
+	block_meta_data_t *free_block)
+{
+
+	assert(free_block->is_free == MM_TRUE);
+	uint32_t compared = glthread_priority_insert(
+		&vm_page_family->free_block_priority_list_head,
+		&free_block->priority_thread_glue,
+		free_blocks_comparison_function,
+		offset_of(block_meta_data_t, priority_thread_glue));
+
+	if (compared > MM_LAT_LONG_WALK_COMPARED)
+		mm_lat_mark(MM_LAT_LONG_WALK);
+}
+
+static vm_bool_t mm_split_free_data_block_for_allocation(
+	vm_page_family_t *vm_page_family,
+	block_meta_data_t *block_meta_data,
+	uint32_t size)
+{
+
+	block_meta_data_t *next_block_meta_data = NULL;
+
+	assert(block_meta_data->is_free == MM_TRUE);
+
+	if (block_meta_data->block_size < size)
+	{
+		return MM_FALSE;
+	}
+
+	uint32_t remaining_size = block_meta_data->block_size - size;
+
+	block_meta_data->is_free = MM_FALSE;
+	block_meta_data->block_size = size;
+	remove_glthread(&block_meta_data->priority_thread_glue);
+	/*block_meta_data->offset = ??*/
+	/*case 1: No split*/
+	if (!remaining_size)
+	{
+		return MM_TRUE;
+	}
+
+	/*case 2: Partial split : soft internal fragmentation*/
+	else if (sizeof(block_meta_data_t) < remaining_size &&
+			 remaining_size < (sizeof(block_meta_data_t) + vm_page_family->struct_size))
+	{
+		/*Now meta block is to be created*/
+		next_block_meta_data = NEXT_META_BLOCK_BY_SIZE(block_meta_data);
+		next_block_meta_data->is_free = MM_TRUE;
+		next_block_meta_data->is_deferred = MM_FALSE;
+		next_block_meta_data->block_size = remaining_size - sizeof(block_meta_data_t);
+		next_block_meta_data->offset = block_meta_data->offset + sizeof(block_meta_data_t) + block_meta_data->block_size;
+		init_glthread(&next_block_meta_data->priority_thread_glue);
+		mm_add_free_block_meta_data_to_free_block_list(
+			vm_page_family, next_block_meta_data);
+		mm_bind_blocks_for_allocation(block_meta_data, next_block_meta_data);
+	}
+
+	/*case 3 : partial split : Hard internal fragmentation*/
+	else if (remaining_size < sizeof(block_meta_data_t))
+	{
+		/*No need to do anythin !!*/
+	}
+
+	/*case 2 : Sull Split : New Meta block is created*/
+	else
+	{
+		/*New Meta block is to be created*/
+		next_block_meta_data = NEXT_META_BLOCK_BY_SIZE(block_meta_data);
+		next_block_meta_data->is_free = MM_TRUE;
+		next_block_meta_data->is_deferred = MM_FALSE;
+		next_block_meta_data->block_size = remaining_size - sizeof(block_meta_data_t);
+		next_block_meta_data->offset = block_meta_data->offset + sizeof(block_meta_data_t) + block_meta_data->block_size;
+		init_glthread(&next_block_meta_data->priority_thread_glue);
+		mm_add_free_block_meta_data_to_free_block_list(
+			vm_page_family, next_block_meta_data);
+		mm_bind_blocks_for_allocation(block_meta_data, next_block_meta_data);
+	}
+
+	if (next_block_meta_data && vm_page_family->bump_last == block_meta_data)
+		vm_page_family->bump_last = next_block_meta_data;
+
+	return MM_TRUE;
+}
+
+static block_meta_data_t *mm_free_blocks(block_meta_data_t *to_be_free_block);
+
+/*Lazy splitting : hand out req_size bytes of the untouched tail of the
+	bump page by moving bump_ptr. Only the header of the new block is
+	written, no free block is made of the rest and the free block list
+	is not touched*/
+static block_meta_data_t *mm_bump_allocate(vm_page_family_t *vm_page_family,
+										   uint32_t req_size)
+{
+	vm_page_t *vm_page = vm_page_family->bump_page;
+	block_meta_data_t *block_meta_data = (block_meta_data_t *)vm_page_family->bump_ptr;
+
+	if (!vm_page ||
+		vm_page_family->bump_ptr + sizeof(block_meta_data_t) + req_size >
+			(char *)vm_page + vm_page_family->span_pages * SYSTEM_PAGE_SIZE)
+		return NULL;
+
+	block_meta_data->is_free = MM_FALSE;
+	block_meta_data->is_deferred = MM_FALSE;
+	block_meta_data->block_size = req_size;
+	block_meta_data->offset = (char *)block_meta_data - (char *)vm_page;
+	init_glthread(&block_meta_data->priority_thread_glue);
+	block_meta_data->prev_block = vm_page_family->bump_last;
+	block_meta_data->next_block = NULL;
+	if (vm_page_family->bump_last)
+		vm_page_family->bump_last->next_block = block_meta_data;
+
+	vm_page_family->bump_last = block_meta_data;
+	vm_page_family->bump_ptr = (char *)NEXT_META_BLOCK_BY_SIZE(block_meta_data);
+	return block_meta_data;
+}
+
+/*The bump page goes back to split and merge : its untouched tail
+	becomes a free block, merged with a free last block*/
+static void mm_retire_bump_page(vm_page_family_t *vm_page_family)
+{
+	vm_page_t *vm_page = vm_page_family->bump_page;
+	block_meta_data_t *tail_block = (block_meta_data_t *)vm_page_family->bump_ptr;
+	block_meta_data_t *last_block = vm_page_family->bump_last;
+
+	if (!vm_page)
+		return;
+
+	char *page_end = (char *)vm_page + vm_page_family->span_pages * SYSTEM_PAGE_SIZE;
+
+	vm_page_family->bump_page = NULL;
+	vm_page_family->bump_last = NULL;
+	vm_page_family->bump_ptr = NULL;
+
+	/*Too short for an object : hard internal fragmentation of the last
+		block, taken now if that one is free, else when it is freed*/
+	if (page_end - (char *)tail_block < sizeof(block_meta_data_t) +
+											vm_page_family->struct_size)
+	{
+		if (last_block && last_block->is_free && !last_block->is_deferred)
+		{
+			remove_glthread(&last_block->priority_thread_glue);
+			last_block->block_size = page_end - (char *)(last_block + 1);
+			mm_add_free_block_meta_data_to_free_block_list(vm_page_family, last_block);
+		}
+		return;
+	}
+
+	tail_block->is_free = MM_FALSE;
+	tail_block->is_deferred = MM_FALSE;
+	tail_block->block_size = page_end - (char *)(tail_block + 1);
+	tail_block->offset = (char *)tail_block - (char *)vm_page;
+	init_glthread(&tail_block->priority_thread_glue);
+	tail_block->prev_block = last_block;
+	tail_block->next_block = NULL;
+	if (last_block)
+		last_block->next_block = tail_block;
+	mm_free_blocks(tail_block);
+}
+
+/*Add a page to the family, it becomes the bump page*/
+static vm_page_t *mm_family_new_page_add(vm_page_family_t *vm_page_family)
+{
+	mm_lat_mark(MM_LAT_NEW_PAGE);
+
+	vm_page_t *vm_page = allocate_vm_page(vm_page_family);
+
+	if (!vm_page)
+		return NULL;
+
+	mm_retire_bump_page(vm_page_family);
+
+	block_meta_data_t *first_block = mm_vm_page_first_data_block(vm_page);
+
+	vm_page_family->bump_page = vm_page;
+	vm_page_family->bump_last = first_block->prev_block; /*coloring pad or none*/
+	vm_page_family->bump_ptr = (char *)first_block;
+	return vm_page;
+}
+
+/*MM_STRATEGY_SLOTS : cut a page just added into single object blocks.
+	The first one is returned allocated, the others are parked on the
+	deferred free list, lowest address first, for XCALLOC(1, ...) to
+	take them as is. The tail too short for one more object is hard
+	internal fragmentation of the last block*/
+static block_meta_data_t *mm_carve_vm_page_into_slots(
+	vm_page_family_t *vm_page_family,
+	vm_page_t *vm_page)
+{
+	block_meta_data_t *first_block = mm_vm_page_first_data_block(vm_page);
+	block_meta_data_t *block_meta_data = first_block;
+	block_meta_data_t *prev_block = first_block->prev_block;
+	uint32_t slot_size = sizeof(block_meta_data_t) + vm_page_family->struct_size;
+	uint32_t slots = (sizeof(block_meta_data_t) + first_block->block_size) / slot_size;
+	uint32_t i;
+
+	remove_glthread(&first_block->priority_thread_glue);
+
+	for (i = 0; i < slots; i++)
+	{
+		block_meta_data = (block_meta_data_t *)((char *)first_block + i * slot_size);
+		block_meta_data->is_free = MM_FALSE;
+		block_meta_data->is_deferred = MM_FALSE;
+		block_meta_data->block_size = vm_page_family->struct_size;
+		block_meta_data->offset = (char *)block_meta_data - (char *)vm_page;
+		init_glthread(&block_meta_data->priority_thread_glue);
+		block_meta_data->prev_block = prev_block;
+		block_meta_data->next_block = NULL;
+		if (prev_block)
+			prev_block->next_block = block_meta_data;
+		prev_block = block_meta_data;
+	}
+
+	for (; block_meta_data != first_block; block_meta_data = block_meta_data->prev_block)
+	{
+		block_meta_data->is_deferred = MM_TRUE;
+		glthread_add_next(&vm_page_family->deferred_free_list_head,
+						  &block_meta_data->priority_thread_glue);
+		vm_page_family->deferred_count++;
+	}
+
+	return first_block;
+}
+
+/*Batch coalescing : run the regular free path on every parked block*/
+static void mm_family_flush_deferred_frees(vm_page_family_t *vm_page_family)
+{
+	glthread_t *curr = NULL;
+	block_meta_data_t *block_meta_data = NULL;
+
+	ITERATE_GLTHREAD_BEGIN(&vm_page_family->deferred_free_list_head, curr)
+	{
+		block_meta_data = glthread_to_block_meta_data(curr);
+		remove_glthread(curr);
+		block_meta_data->is_deferred = MM_FALSE;
+		mm_free_blocks(block_meta_data);
+	}
+	ITERATE_GLTHREAD_END(&vm_page_family->deferred_free_list_head, curr);
+
+	vm_page_family->deferred_count = 0;
+}
+
+/*Parked blocks allowed, MM_STRATEGY_SLOTS raises the user setting*/
+static uint32_t mm_family_max_deferred(vm_page_family_t *vm_page_family)
+{
+	if (vm_page_family->strategy == MM_STRATEGY_SLOTS &&
+		vm_page_family->max_deferred < MM_ADAPT_SLOTS_MAX_DEFERRED)
+		return MM_ADAPT_SLOTS_MAX_DEFERRED;
+	return vm_page_family->max_deferred;
+}
+
+/*Park a single object block on the family deferred free list instead
+	of merging it, returns MM_FALSE when the block is to be freed now*/
+static vm_bool_t mm_defer_free_block(block_meta_data_t *block_meta_data)
+{
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+	vm_page_family_t *vm_page_family = hosting_page->pg_family;
+
+	uint32_t max_deferred = mm_family_max_deferred(vm_page_family);
+
+	if (!max_deferred ||
+		block_meta_data->block_size != vm_page_family->struct_size)
+		return MM_FALSE;
+
+	if (vm_page_family->deferred_count >= max_deferred)
+		mm_family_flush_deferred_frees(vm_page_family);
+
+	block_meta_data->is_deferred = MM_TRUE;
+	glthread_add_next(&vm_page_family->deferred_free_list_head,
+					  &block_meta_data->priority_thread_glue);
+	vm_page_family->deferred_count++;
+	return MM_TRUE;
+}
+
+/*Reuse the most recently parked block as is, no split needed*/
+static block_meta_data_t *mm_reuse_deferred_block(vm_page_family_t *vm_page_family)
+{
+	glthread_t *glue = dequeue_glthread_first(&vm_page_family->deferred_free_list_head);
+
+	if (!glue)
+		return NULL;
+
+	block_meta_data_t *block_meta_data = glthread_to_block_meta_data(glue);
+	block_meta_data->is_deferred = MM_FALSE;
+	vm_page_family->deferred_count--;
+	return block_meta_data;
+}
+
+static block_meta_data_t *mm_allocate_free_data_block(
+	vm_page_family_t *vm_page_family,
+	uint32_t req_size)
+{
+
+	vm_bool_t status = MM_FALSE;
+	vm_page_t *vm_page = NULL;
+	block_meta_data_t *block_meta_data = NULL;
+
+	/*MM_STRATEGY_BUMP : fresh memory first, freed blocks after*/
+	if (vm_page_family->strategy == MM_STRATEGY_BUMP &&
+		(block_meta_data = mm_bump_allocate(vm_page_family, req_size)))
+		return block_meta_data;
+
+	block_meta_data_t *biggest_block_meta_data = mm_get_biggest_free_block_page_family(vm_page_family);
+
+	/*Merge parked blocks before growing the family*/
+	if (vm_page_family->deferred_count &&
+		(!biggest_block_meta_data || biggest_block_meta_data->block_size < req_size))
+	{
+		mm_family_flush_deferred_frees(vm_page_family);
+		biggest_block_meta_data = mm_get_biggest_free_block_page_family(vm_page_family);
+	}
+
+	if (!biggest_block_meta_data ||
+		biggest_block_meta_data->block_size < req_size)
+	{
+		/*No free block fits, bump the fresh page*/
+		block_meta_data = mm_bump_allocate(vm_page_family, req_size);
+
+		if (block_meta_data)
+			return block_meta_data;
+
+		if (vm_page_family->strategy == MM_STRATEGY_SLOTS &&
+			req_size == vm_page_family->struct_size)
+		{
+			mm_lat_mark(MM_LAT_NEW_PAGE);
+			vm_page = allocate_vm_page(vm_page_family);
+			return vm_page ? mm_carve_vm_page_into_slots(vm_page_family, vm_page) : NULL;
+		}
+
+		/*Time to add a new page to Page family to satisfy the request*/
+		vm_page = mm_family_new_page_add(vm_page_family);
+
+		if (!vm_page)
+			return NULL;
+
+		block_meta_data = mm_bump_allocate(vm_page_family, req_size);
+
+		/*Not even a fresh page serves it : give the page back rather
+			than keep a free block off the free block list*/
+		if (!block_meta_data)
+			mm_retire_bump_page(vm_page_family);
+
+		return block_meta_data;
+	}
+
+	/*The biggest block meta data can satisfy the request*/
+	if (biggest_block_meta_data)
+	{
+		status = mm_split_free_data_block_for_allocation(vm_page_family,
+														 biggest_block_meta_data, req_size);
+	}
+
+	if (status)
+		return biggest_block_meta_data;
+
+	return NULL;
+}
+
+static block_meta_data_t *mm_free_blocks(
+	block_meta_data_t *to_be_free_block)
+{
+	block_meta_data_t *return_block = NULL;
+
+	assert(to_be_free_block->is_free == MM_FALSE);
+
+	vm_page_t *hosting_page =
+		MM_GET_PAGE_FROM_META_BLOCK(to_be_free_block);
+
+	vm_page_family_t *vm_page_family = hosting_page->pg_family;
+
+	return_block = to_be_free_block;
+
+	to_be_free_block->is_free = MM_TRUE;
+	hosting_page->purged = MM_FALSE;
+
+	block_meta_data_t *next_block = NEXT_META_BLOCK(to_be_free_block);
+
+	/*Handing Hard IF memory*/
+	if (next_block)
+	{
+		/*Scenario 1 : When data block to be freed is not the last
+			upper most meta block in a VM data page*/
+		to_be_free_block->block_size +=
+			mm_get_hard_internal_memory_frag_size(to_be_free_block, next_block);
+	}
+	else
+	{
+		/* Scenario 2 : Page Boundry condition*/
+		/* Block being freed is the upper most free data block
+			in a VM data page, check of hard internal fragmented
+			memory and merge*/
+		/*The bump page ends, for now, where its untouched tail starts*/
+		char *end_address_of_vm_page = hosting_page == vm_page_family->bump_page ?
+										   vm_page_family->bump_ptr :
+										   (char *)hosting_page + vm_page_family->span_pages * SYSTEM_PAGE_SIZE;
+		char *end_address_of_free_data_block =
+			(char *)(to_be_free_block + 1) + to_be_free_block->block_size;
+		int internal_mem_fragmentation = (int)((unsigned long)end_address_of_vm_page -
+											   (unsigned long)end_address_of_free_data_block);
+		to_be_free_block->block_size += internal_mem_fragmentation;
+	}
+
+	/*Now perform Mergin*/
+	if (next_block && next_block->is_free == MM_TRUE)
+	{
+		/*Union two free blocks*/
+		mm_union_free_blocks(to_be_free_block, next_block);
+		return_block = to_be_free_block;
+	}
+
+	/*Check the previous block if it was free*/
+	block_meta_data_t *prev_block = PREV_META_BLOCK(to_be_free_block);
+
+	if (prev_block && prev_block->is_free)
+	{
+		mm_union_free_blocks(prev_block, to_be_free_block);
+		return_block = prev_block;
+	}
+
+	if (mm_is_vm_page_empty(hosting_page))
+	{
+		mm_vm_page_delete_and_free(hosting_page);
+		return NULL;
+	}
+	mm_add_free_block_meta_data_to_free_block_list(
+		hosting_page->pg_family, return_block);
+
+	return return_block;
+}
+
+static int mm_get_hard_internal_memory_frag_size(
+	block_meta_data_t *first,
+	block_meta_data_t *second)
+{
+	block_meta_data_t *next_block = NEXT_META_BLOCK_BY_SIZE(first);
+	return (int)((unsigned long)second - (unsigned long)next_block);
+}
+
+static void mm_union_free_blocks(block_meta_data_t *first,
+								 block_meta_data_t *second)
+{
+	assert(first->is_free == MM_TRUE &&
+		   second->is_free == MM_TRUE);
+
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(first);
+	vm_page_family_t *vm_page_family = hosting_page->pg_family;
+
+	/*Merged block is re-inserted in the priority list by the caller*/
+	remove_glthread(&first->priority_thread_glue);
+	remove_glthread(&second->priority_thread_glue);
+
+	if (vm_page_family->bump_last == second)
+		vm_page_family->bump_last = first;
+
+	first->block_size += sizeof(block_meta_data_t) + second->block_size;
+
+	first->next_block = second->next_block;
+
+	if (second->next_block)
+		second->next_block->prev_block = first;
+}
+
+#ifdef MM_RSEQ
+
+/*rseq critical section : the descriptor goes to __rseq_cs and is
+	published in the thread rseq area, the section runs from label 1 to
+	the commit store ending at label 2. On preemption, migration or a
+	signal inside it the kernel resumes at label 4, right after the rseq
+	signature, which jumps to the abort label of the C code*/
+#define MM_RSEQ_CS_BEGIN                   \
+	".pushsection __rseq_cs, \"aw\"\n\t"    \
+	".balign 32\n\t"                       \
+	"3:\n\t"                                \
+	".long 0x0, 0x0\n\t"                   \
+	".quad 1f, (2f - 1f), 4f\n\t"          \
+	".popsection\n\t"                      \
+	"leaq 3b(%%rip), %%rax\n\t"            \
+	"movq %%rax, %[rseq_cs]\n\t"           \
+	"1:\n\t"                                \
+	"cmpl %[cpu], %[current_cpu]\n\t"      \
+	"jnz 4f\n\t"
+
+#define MM_RSEQ_CS_END                          \
+	"2:\n\t"                                     \
+	".pushsection __rseq_failure, \"ax\"\n\t"    \
+	".byte 0x0f, 0xb9, 0x3d\n\t"                \
+	".long 0x53053053\n\t" /*RSEQ_SIG*/         \
+	"4:\n\t"                                     \
+	"jmp %l[abort]\n\t"                         \
+	".popsection\n\t"
+
+static inline struct rseq *mm_rseq_area()
+{
+	char *thread_pointer;
+
+	__asm__("movq %%fs:0, %0" : "=r"(thread_pointer));
+	return (struct rseq *)(thread_pointer + __rseq_offset);
+}
+
+/*Cache of the CPU the thread runs on, NULL when the family has no
+	caches or rseq is not registered for the thread. The caches pointer
+	is loaded once : unregistering the family clears it*/
+static inline mm_cpu_cache_t *mm_cpu_cache_current(vm_page_family_t *pg_family,
+												   struct rseq *rseq_area,
+												   uint32_t *cpu)
+{
+	mm_cpu_cache_t *cpu_caches = __atomic_load_n(&pg_family->cpu_caches, __ATOMIC_ACQUIRE);
+
+	if (!cpu_caches)
+		return NULL;
+
+	*cpu = *(volatile uint32_t *)&rseq_area->cpu_id;
+
+	if (*cpu >= mm_cpu_count)
+		return NULL;
+	return &cpu_caches[*cpu];
+}
+
+/*1 : *block popped, 0 : cache empty or stopped, -1 : interrupted, retry*/
+static inline int mm_cpu_cache_try_pop(vm_page_family_t *pg_family,
+									   block_meta_data_t **block)
+{
+	struct rseq *rseq_area = mm_rseq_area();
+	uint32_t cpu;
+	mm_cpu_cache_t *cache = mm_cpu_cache_current(pg_family, rseq_area, &cpu);
+
+	if (!cache)
+		return 0;
+
+	__asm__ __volatile__ goto(
+		MM_RSEQ_CS_BEGIN
+		"cmpq $0, %[stopped]\n\t"
+		"jnz %l[empty]\n\t"
+		"movq %[count], %%rax\n\t"
+		"testq %%rax, %%rax\n\t"
+		"jz %l[empty]\n\t"
+		"movq -8(%[blocks], %%rax, 8), %%rdx\n\t"
+		"movq %%rdx, (%[block])\n\t"
+		"decq %%rax\n\t"
+		"movq %%rax, %[count]\n\t" /*commit*/
+		MM_RSEQ_CS_END
+		:
+		: [cpu] "r"(cpu), [current_cpu] "m"(rseq_area->cpu_id),
+		  [rseq_cs] "m"(rseq_area->rseq_cs), [stopped] "m"(cache->stopped),
+		  [count] "m"(cache->count), [blocks] "r"(cache->blocks), [block] "r"(block)
+		: "rax", "rdx", "memory", "cc"
+		: empty, abort);
+	return 1;
+empty:
+	return 0;
+abort:
+	return -1;
+}
+
+/*1 : block pushed, 0 : cache full or stopped, -1 : interrupted, retry*/
+static inline int mm_cpu_cache_try_push(vm_page_family_t *pg_family,
+										block_meta_data_t *block)
+{
+	struct rseq *rseq_area = mm_rseq_area();
+	uint32_t cpu;
+	mm_cpu_cache_t *cache = mm_cpu_cache_current(pg_family, rseq_area, &cpu);
+
+	if (!cache)
+		return 0;
+
+	__asm__ __volatile__ goto(
+		MM_RSEQ_CS_BEGIN
+		"cmpq $0, %[stopped]\n\t"
+		"jnz %l[full]\n\t"
+		"movq %[count], %%rax\n\t"
+		"cmpq %[slots], %%rax\n\t"
+		"jae %l[full]\n\t"
+		"movq %[block], (%[blocks], %%rax, 8)\n\t"
+		"incq %%rax\n\t"
+		"movq %%rax, %[count]\n\t" /*commit*/
+		MM_RSEQ_CS_END
+		:
+		: [cpu] "r"(cpu), [current_cpu] "m"(rseq_area->cpu_id),
+		  [rseq_cs] "m"(rseq_area->rseq_cs), [stopped] "m"(cache->stopped),
+		  [count] "m"(cache->count), [blocks] "r"(cache->blocks), [block] "r"(block),
+		  [slots] "i"(MM_CPU_CACHE_SLOTS)
+		: "rax", "memory", "cc"
+		: full, abort);
+	return 1;
+full:
+	return 0;
+abort:
+	return -1;
+}
+
+static block_meta_data_t *mm_cpu_cache_pop(vm_page_family_t *pg_family)
+{
+	block_meta_data_t *block = NULL;
+	int rc;
+
+	while ((rc = mm_cpu_cache_try_pop(pg_family, &block)) < 0)
+		;
+	return rc ? block : NULL;
+}
+
+static vm_bool_t mm_cpu_cache_push(vm_page_family_t *pg_family, block_meta_data_t *block)
+{
+	int rc;
+
+	while ((rc = mm_cpu_cache_try_push(pg_family, block)) < 0)
+		;
+	return rc ? MM_TRUE : MM_FALSE;
+}
+
+/*Once it returns no thread is inside a critical section on a cache of
+	the family, and none will commit one until the caches are restarted*/
+static void mm_cpu_caches_stop(vm_page_family_t *pg_family)
+{
+	uint32_t cpu;
+
+	for (cpu = 0; cpu < mm_cpu_count; cpu++)
+		pg_family->cpu_caches[cpu].stopped = 1;
+	syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ, 0, 0);
+}
+
+#else
+
+static block_meta_data_t *mm_cpu_cache_pop(vm_page_family_t *pg_family)
+{
+	return NULL;
+}
+
+static vm_bool_t mm_cpu_cache_push(vm_page_family_t *pg_family, block_meta_data_t *block)
+{
+	return MM_FALSE;
+}
+
+static void mm_cpu_caches_stop(vm_page_family_t *pg_family)
+{
+}
+
+#endif /*MM_RSEQ*/
+
+/*VM pages taking the per-CPU caches of one family*/
+static uint32_t mm_cpu_caches_units()
+{
+	return (mm_cpu_count * sizeof(mm_cpu_cache_t) + SYSTEM_PAGE_SIZE - 1) /
+		   SYSTEM_PAGE_SIZE;
+}
+
+/*Empty all per-CPU caches of a family, giving their blocks back to
+	the family when free_blocks is set. Called with the lock held*/
+static void mm_family_drain_cpu_caches(vm_page_family_t *pg_family, vm_bool_t free_blocks)
+{
+	uint32_t cpu, i;
+
+	if (!pg_family->cpu_caches)
+		return;
+
+	mm_cpu_caches_stop(pg_family);
+
+	for (cpu = 0; cpu < mm_cpu_count; cpu++)
+	{
+		mm_cpu_cache_t *cache = &pg_family->cpu_caches[cpu];
+
+		for (i = 0; free_blocks && i < cache->count; i++)
+		{
+			if (!mm_defer_free_block(cache->blocks[i]))
+				mm_free_blocks(cache->blocks[i]);
+		}
+		cache->count = 0;
+		__atomic_store_n(&cache->stopped, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/*Locked path of a single object allocation : create the caches of the
+	family on first use, then fill the cache of the current CPU*/
+static void mm_cpu_cache_refill(vm_page_family_t *pg_family)
+{
+	block_meta_data_t *block_meta_data = NULL;
+	uint32_t i;
+
+	if (!pg_family->cpu_caches)
+	{
+		mm_cpu_cache_t *cpu_caches = mm_budget_admit(NULL, mm_cpu_caches_units()) ?
+										 mm_get_new_vm_page_from_kernel(mm_cpu_caches_units()) :
+										 NULL;
+
+		if (!cpu_caches)
+			return;
+		__atomic_store_n(&pg_family->cpu_caches, cpu_caches, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < MM_CPU_CACHE_BATCH; i++)
+	{
+		block_meta_data = pg_family->deferred_count ? mm_reuse_deferred_block(pg_family) : NULL;
+
+		if (!block_meta_data)
+			block_meta_data = mm_allocate_free_data_block(pg_family, pg_family->struct_size);
+
+		if (!block_meta_data)
+			return;
+
+		if (!mm_cpu_cache_push(pg_family, block_meta_data))
+		{
+			mm_free_blocks(block_meta_data);
+			return;
+		}
+	}
+}
+
+/*Locked path of a free which found the cache of its CPU full : move a
+	batch out of it, so that the next frees take the fast path again*/
+static void mm_cpu_cache_spill(vm_page_family_t *pg_family)
+{
+	block_meta_data_t *block_meta_data = NULL;
+	uint32_t i;
+
+	for (i = 0; i < MM_CPU_CACHE_BATCH; i++)
+	{
+		block_meta_data = mm_cpu_cache_pop(pg_family);
+
+		if (!block_meta_data)
+			return;
+
+		if (!mm_defer_free_block(block_meta_data))
+			mm_free_blocks(block_meta_data);
+	}
+}
+
+static void mm_family_release_cpu_caches(vm_page_family_t *pg_family)
+{
+	if (!pg_family->cpu_caches)
+		return;
+
+	mm_family_drain_cpu_caches(pg_family, MM_FALSE);
+	mm_return_vm_page_to_kernel(pg_family->cpu_caches, mm_cpu_caches_units());
+	pg_family->cpu_caches = NULL;
+}
+
+vm_page_family_t *lookup_page_family_by_name(char *struct_name)
+{
+	vm_page_family_t *vm_page_family_curr = NULL;
+	vm_page_for_families_t *vm_page_for_families_curr = NULL;
+
+	for (vm_page_for_families_curr = first_vm_page_for_families;
+		 vm_page_for_families_curr;
+		 vm_page_for_families_curr = vm_page_for_families_curr->next)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families_curr, vm_page_family_curr)
+		{
+
+			if (strncmp(vm_page_family_curr->struct_name,
+						struct_name,
+						MM_MAX_STRUCT_NAME) == 0)
+			{
+
+				return vm_page_family_curr;
+			}
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families_curr, vm_page_family_curr);
+	}
+	return NULL;
+}
+
+/*Called with the lock held. Objects of the family waiting on the epoch
+	limbo lists go with its pages, reclaim must not free them later*/
+static void mm_epoch_purge_family(vm_page_family_t *vm_page_family)
+{
+	glthread_t *curr = NULL;
+	block_meta_data_t *block_meta_data = NULL;
+	vm_page_t *hosting_page = NULL;
+	uint32_t i;
+
+	pthread_mutex_lock(&mm_epoch_mutex);
+	for (i = 0; i < MM_EPOCH_LIMBO_LISTS; i++)
+	{
+		ITERATE_GLTHREAD_BEGIN(&mm_epoch_limbo[i], curr)
+		{
+			block_meta_data = glthread_to_block_meta_data(curr);
+			hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+			if (hosting_page->pg_family == vm_page_family)
+				remove_glthread(curr);
+		}
+		ITERATE_GLTHREAD_END(&mm_epoch_limbo[i], curr);
+	}
+	pthread_mutex_unlock(&mm_epoch_mutex);
+}
+
+/*Return all VM pages of a page family to kernel in one pass without
+	visiting individual blocks, the family stays registered*/
+static void mm_family_release_all_pages(vm_page_family_t *vm_page_family)
+{
+	vm_page_t *vm_page = vm_page_family->first_page;
+	vm_page_t *next = NULL;
+
+	mm_family_drain_cpu_caches(vm_page_family, MM_FALSE);
+	mm_epoch_purge_family(vm_page_family);
+
+	for (; vm_page; vm_page = next)
+	{
+		next = vm_page->next;
+		/*probe mm:page_free(struct_name, vm_page, bytes)*/
+		MM_PROBE3(page_free, vm_page_family->struct_name, vm_page,
+				  (size_t)vm_page_family->span_pages * SYSTEM_PAGE_SIZE);
+		mm_return_vm_page_to_kernel((void *)vm_page, vm_page_family->span_pages);
+	}
+
+	mm_page_directory_release(vm_page_family);
+	mm_directory_release(&vm_page_family->object_directory);
+	vm_page_family->first_page = NULL;
+	vm_page_family->page_count = 0;
+	init_glthread(&vm_page_family->free_block_priority_list_head);
+	init_glthread(&vm_page_family->deferred_free_list_head);
+	vm_page_family->deferred_count = 0;
+	vm_page_family->bump_page = NULL;
+	vm_page_family->bump_last = NULL;
+	vm_page_family->bump_ptr = NULL;
+}
+
+void mm_family_free_all(char *struct_name)
+{
+	mm_lock();
+
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+		mm_unlock();
+		return;
+	}
+
+	mm_family_release_all_pages(pg_family);
+	if (mm_adaptive_strategy)
+		pg_family->window_bulk_frees++;
+	mm_unlock();
+}
+
+/*Move a page family record to another slot of the registry, VM pages
+	and the free block list keep back pointers into the record*/
+static void mm_move_page_family(vm_page_family_t *dst,
+								vm_page_family_t *src)
+{
+	vm_page_t *vm_page = NULL;
+
+	memcpy(dst, src, sizeof(vm_page_family_t));
+
+	if (dst->free_block_priority_list_head.right)
+		dst->free_block_priority_list_head.right->left =
+			&dst->free_block_priority_list_head;
+
+	if (dst->deferred_free_list_head.right)
+		dst->deferred_free_list_head.right->left =
+			&dst->deferred_free_list_head;
+
+	ITERATE_VM_PAGE_BEGIN(dst, vm_page)
+	{
+		vm_page->pg_family = dst;
+	}
+	ITERATE_VM_PAGE_END(dst, vm_page);
+}
+
+void mm_unregister_page_family(char *struct_name)
+{
+	mm_lock();
+
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+		mm_unlock();
+		return;
+	}
+
+	mm_family_release_cpu_caches(pg_family);
+	mm_family_release_all_pages(pg_family);
+
+	/*Registration always fills the first VM page for families, all
+		others stay full. Keep it that way by moving the last family
+		of the first page into the slot being reclaimed*/
+	vm_page_family_t *vm_page_family_curr = NULL;
+	vm_page_family_t *last_page_family = NULL;
+
+	ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
+	{
+		last_page_family = vm_page_family_curr;
+	}
+	ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_family_curr);
+
+	if (last_page_family != pg_family)
+		mm_move_page_family(pg_family, last_page_family);
+
+	/*Family handles cached by callers may now be stale*/
+	if (shared_heap)
+		__atomic_add_fetch(&shared_heap->family_generation, 1, __ATOMIC_RELEASE);
+	else
+		page_family_generation++;
+
+	memset(last_page_family, 0, sizeof(vm_page_family_t));
+
+	/*Give the first VM page for families back to kernel once empty*/
+	if (first_vm_page_for_families->vm_page_family[0].struct_size == 0)
+	{
+		vm_page_for_families_t *vm_page_for_families = first_vm_page_for_families;
+		first_vm_page_for_families = vm_page_for_families->next;
+		mm_return_vm_page_to_kernel((void *)vm_page_for_families, 1);
+	}
+	mm_unlock();
+}
+
+/*Switch the strategy of the family, slots parked past the new limit
+	are given back*/
+static void mm_family_set_strategy(vm_page_family_t *vm_page_family, uint32_t strategy)
+{
+	if (vm_page_family->strategy == strategy)
+		return;
+
+	vm_page_family->strategy = strategy;
+
+	if (vm_page_family->deferred_count > mm_family_max_deferred(vm_page_family))
+		mm_family_flush_deferred_frees(vm_page_family);
+}
+
+/*Pick the strategy of the pages the family adds next from the traffic
+	of the window just ended, then start a new window. Staying with BUMP
+	needs no new mm_family_free_all() call, a window may fall between two*/
+static void mm_family_adapt(vm_page_family_t *vm_page_family)
+{
+	uint32_t allocs = vm_page_family->window_allocs;
+	uint32_t strategy = MM_STRATEGY_GENERAL;
+
+	if (vm_page_family->window_frees * 16 <= allocs &&
+		(vm_page_family->window_bulk_frees ||
+		 vm_page_family->strategy == MM_STRATEGY_BUMP))
+		strategy = MM_STRATEGY_BUMP;
+	else if (vm_page_family->window_single_allocs * 16 >= allocs * 15 &&
+			 vm_page_family->window_frees * 4 >= allocs)
+		strategy = MM_STRATEGY_SLOTS;
+
+	mm_family_set_strategy(vm_page_family, strategy);
+
+	vm_page_family->window_allocs = 0;
+	vm_page_family->window_single_allocs = 0;
+	vm_page_family->window_frees = 0;
+	vm_page_family->window_bulk_frees = 0;
+}
+
+static void *mm_xcalloc(vm_page_family_t *pg_family, int units)
+{
+	if ((units * pg_family->struct_size) > mm_family_max_request(pg_family))
+	{
+		printf("Error : Memory Requested exceeds span size\n");
+		return NULL;
+	}
+
+	if (mm_adaptive_strategy)
+	{
+		pg_family->window_allocs++;
+		if (units == 1)
+			pg_family->window_single_allocs++;
+		if (pg_family->window_allocs == MM_ADAPT_WINDOW)
+			mm_family_adapt(pg_family);
+	}
+
+	/*Find the page which can satisfy the request*/
+	block_meta_data_t *free_block_meta_data = NULL;
+
+	if (units == 1 && pg_family->deferred_count)
+		free_block_meta_data = mm_reuse_deferred_block(pg_family);
+
+	if (!free_block_meta_data)
+		free_block_meta_data = mm_allocate_free_data_block(
+			pg_family, units * pg_family->struct_size);
+
+	void *app_ptr = NULL;
+
+	if (free_block_meta_data)
+	{
+		memset((char *)(free_block_meta_data + 1), 0,
+			   free_block_meta_data->block_size);
+		app_ptr = (void *)(free_block_meta_data + 1);
+	}
+
+	/*probe mm:xcalloc(struct_name, units, bytes, app_ptr), app_ptr is
+		NULL when the allocation failed*/
+	MM_PROBE4(xcalloc, pg_family->struct_name, units,
+			  units * pg_family->struct_size, app_ptr);
+	return app_ptr;
+}
+
+void *xcalloc(char *struct_name, int units)
+{
+	uint64_t lat_start = mm_lat_begin();
+
+	mm_lock();
+
+	/*step 1*/
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+		mm_unlock();
+		return NULL;
+	}
+
+	if (pg_family->relocatable)
+	{
+		printf("Error : Structure %s is relocatable, allocate it with xcalloc_handle\n", struct_name);
+		mm_unlock();
+		return NULL;
+	}
+
+	void *app_ptr = mm_xcalloc(pg_family, units);
+	mm_unlock();
+	mm_lat_end(MM_LAT_XCALLOC, pg_family, lat_start);
+	return app_ptr;
+}
+
+/*Single object allocation from the cache of the CPU, takes no lock*/
+static void *mm_cpu_cache_xcalloc(vm_page_family_t *pg_family)
+{
+	if (!__atomic_load_n(&pg_family->cpu_caches, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	block_meta_data_t *block_meta_data = mm_cpu_cache_pop(pg_family);
+
+	if (!block_meta_data)
+		return NULL;
+
+	memset((char *)(block_meta_data + 1), 0, block_meta_data->block_size);
+	MM_PROBE4(xcalloc, pg_family->struct_name, 1, pg_family->struct_size,
+			  block_meta_data + 1);
+	return (void *)(block_meta_data + 1);
+}
+
+/*Allocate from a family handle obtained from mm_page_family_bind(),
+	skips the lookup by structure name*/
+void *xcalloc_family(vm_page_family_t *pg_family, int units)
+{
+	uint64_t lat_start = mm_lat_begin();
+	void *app_ptr = units == 1 ? mm_cpu_cache_xcalloc(pg_family) : NULL;
+
+	if (!app_ptr && pg_family->relocatable)
+	{
+		printf("Error : Structure %s is relocatable, allocate it with xcalloc_handle\n",
+			   pg_family->struct_name);
+		return NULL;
+	}
+
+	if (!app_ptr)
+	{
+		mm_lock();
+		app_ptr = mm_xcalloc(pg_family, units);
+		if (app_ptr && units == 1 && mm_cpu_caches_on)
+			mm_cpu_cache_refill(pg_family);
+		mm_unlock();
+	}
+	mm_lat_end(MM_LAT_XCALLOC, pg_family, lat_start);
+	return app_ptr;
+}
+
+vm_page_family_t *mm_page_family_bind(char *struct_name, uint32_t struct_size)
+{
+	/*One lock hold, so that two threads binding a new name do not
+		both register it*/
+	mm_lock();
+	vm_page_family_t *pg_family = lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		mm_instantiate_new_page_family(struct_name, struct_size);
+		pg_family = lookup_page_family_by_name(struct_name);
+	}
+	mm_unlock();
+
+	if (pg_family && pg_family->struct_size != struct_size)
+	{
+		printf("Error : Structure %s is registered with size %u\n",
+			   struct_name, pg_family->struct_size);
+		return NULL;
+	}
+
+	return pg_family;
+}
+
+uint32_t mm_max_allocation_size(vm_page_family_t *pg_family)
+{
+	return mm_family_max_request(pg_family);
+}
+
+uint32_t mm_page_family_generation()
+{
+	if (shared_heap)
+		return __atomic_load_n(&shared_heap->family_generation, __ATOMIC_ACQUIRE);
+	return page_family_generation;
+}
+
+/*Handles : page index in the high bits, byte offset of the object in
+	its page in the low ones. Offset 0 is the page header, so no object
+	has handle 0*/
+uint32_t mm_ptr_to_handle(void *app_ptr)
+{
+	if (!app_ptr)
+		return 0;
+
+	block_meta_data_t *block_meta_data =
+		(block_meta_data_t *)((char *)app_ptr - sizeof(block_meta_data_t));
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+
+	if (!hosting_page->pg_family)
+		return 0;
+
+	return (hosting_page->page_index << hosting_page->pg_family->handle_offset_bits) |
+		   (uint32_t)((char *)app_ptr - (char *)hosting_page);
+}
+
+void *mm_handle_to_ptr(vm_page_family_t *pg_family, uint32_t handle)
+{
+	if (!handle)
+		return NULL;
+
+	mm_page_directory_t *directory =
+		__atomic_load_n(&pg_family->page_directory, __ATOMIC_ACQUIRE);
+	uint32_t page_index = handle >> pg_family->handle_offset_bits;
+	uint32_t offset = handle & ((1u << pg_family->handle_offset_bits) - 1);
+
+	/*A forged or stale handle gets NULL : entries past the ones handed
+		out are zero, free ones are odd*/
+	if (!directory || page_index >= directory->capacity ||
+		offset >= pg_family->span_pages * SYSTEM_PAGE_SIZE)
+		return NULL;
+
+	uintptr_t entry = __atomic_load_n(&directory->entries[page_index], __ATOMIC_ACQUIRE);
+
+	if (!entry || (entry & 1))
+		return NULL;
+
+	return (char *)entry + offset;
+}
+
+/*Size classes of xmalloc : 16 byte steps up to 128 bytes, then 4
+	classes per power of two, which bounds internal waste to 25% of the
+	request. The last class is a whole VM page, bigger requests get
+	VM pages of their own. Classes are laid out for 4K pages, with
+	bigger ones the requests past the last class below 4K take the
+	whole page class*/
+#define MM_XMALLOC_SMALL_MAX 128
+#define MM_XMALLOC_PAGE_SHIFT 12
+#define MM_XMALLOC_SIZE_CLASSES \
+	(MM_XMALLOC_SMALL_MAX / 16 + 4 * (MM_XMALLOC_PAGE_SHIFT - 7))
+
+static struct
+{
+	vm_page_family_t *pg_family;
+	uint32_t generation;
+} mm_xmalloc_size_classes[MM_XMALLOC_SIZE_CLASSES];
+
+static uint32_t mm_xmalloc_size_class(size_t size, uint32_t *class_size_out)
+{
+	uint32_t class_size, index;
+	uint32_t max_class_size = MAX_PAGE_ALLOCATABLE_MEMORY(1);
+
+	if (size <= MM_XMALLOC_SMALL_MAX)
+	{
+		class_size = size <= 16 ? 16 : (size + 15) & ~15;
+		index = class_size / 16 - 1;
+	}
+	else
+	{
+		/*size is in (2^exponent, 2^(exponent + 1)]*/
+		uint32_t exponent = 63 - __builtin_clzll(size - 1);
+		uint32_t step = 1 << (exponent - 2);
+
+		class_size = (size + step - 1) & ~(step - 1);
+		index = MM_XMALLOC_SMALL_MAX / 16 +
+				(exponent - 7) * 4 + (class_size / step - 5);
+
+		if (class_size > max_class_size || index >= MM_XMALLOC_SIZE_CLASSES - 1)
+		{
+			class_size = max_class_size;
+			index = MM_XMALLOC_SIZE_CLASSES - 1;
+		}
+	}
+
+	*class_size_out = class_size;
+	return index;
+}
+
+/*Family of a size class, bound on first use. Called with the lock held*/
+static vm_page_family_t *mm_xmalloc_size_class_family(size_t size)
+{
+	uint32_t class_size;
+	uint32_t index = mm_xmalloc_size_class(size, &class_size);
+	uint32_t generation = mm_page_family_generation();
+
+	if (mm_xmalloc_size_classes[index].pg_family &&
+		mm_xmalloc_size_classes[index].generation == generation)
+		return mm_xmalloc_size_classes[index].pg_family;
+
+	char struct_name[MM_MAX_STRUCT_NAME];
+	snprintf(struct_name, sizeof(struct_name), "xmalloc_%u", class_size);
+
+	mm_xmalloc_size_classes[index].pg_family =
+		mm_page_family_bind(struct_name, class_size);
+	/*Published last for mm_xmalloc_cpu_cache()*/
+	__atomic_store_n(&mm_xmalloc_size_classes[index].generation, generation,
+					 __ATOMIC_RELEASE);
+	return mm_xmalloc_size_classes[index].pg_family;
+}
+
+/*xmalloc from the cache of the CPU, when the size class family is
+	bound already, takes no lock*/
+static void *mm_xmalloc_cpu_cache(size_t size, vm_page_family_t **pg_family)
+{
+	uint32_t class_size;
+	uint32_t index = mm_xmalloc_size_class(size, &class_size);
+	uint32_t generation = __atomic_load_n(&mm_xmalloc_size_classes[index].generation,
+										  __ATOMIC_ACQUIRE);
+
+	*pg_family = mm_xmalloc_size_classes[index].pg_family;
+	if (!*pg_family || generation != mm_page_family_generation())
+		return NULL;
+	return mm_cpu_cache_xcalloc(*pg_family);
+}
+
+/*Allocation bigger than a VM page : VM pages of its own, laid out
+	like a VM data page holding one allocated block. The page has no
+	page family, which is how xfree recognizes it*/
+static void *mm_xmalloc_large(size_t size)
+{
+	if (size > UINT32_MAX - SYSTEM_PAGE_SIZE)
+		return NULL;
+
+	int units = (offset_of(vm_page_t, page_memory) + size + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+
+	if (!mm_budget_admit(NULL, units))
+		return NULL;
+
+	vm_page_t *vm_page = mm_get_new_vm_page_from_kernel(units);
+
+	if (!vm_page)
+		return NULL;
+
+	vm_page->pg_family = NULL;
+	vm_page->block_meta_data.is_free = MM_FALSE;
+	vm_page->block_meta_data.block_size = (uint32_t)size;
+	vm_page->block_meta_data.offset = offset_of(vm_page_t, block_meta_data);
+	return (void *)vm_page->page_memory;
+}
+
+static void mm_xfree_large(vm_page_t *vm_page)
+{
+	int units = (offset_of(vm_page_t, page_memory) + vm_page->block_meta_data.block_size +
+				 SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+
+	mm_return_vm_page_to_kernel((void *)vm_page, units);
+}
+
+void *xmalloc(size_t size)
+{
+	uint64_t lat_start = mm_lat_begin();
+	vm_page_family_t *pg_family = NULL;
+	void *app_ptr = NULL;
+
+	if (mm_cpu_caches_on && size <= MAX_PAGE_ALLOCATABLE_MEMORY(1))
+	{
+		app_ptr = mm_xmalloc_cpu_cache(size, &pg_family);
+		if (app_ptr)
+		{
+			mm_lat_end(MM_LAT_XCALLOC, pg_family, lat_start);
+			return app_ptr;
+		}
+	}
+
+	mm_lock();
+	if (size > MAX_PAGE_ALLOCATABLE_MEMORY(1))
+	{
+		app_ptr = mm_xmalloc_large(size);
+	}
+	else
+	{
+		pg_family = mm_xmalloc_size_class_family(size);
+		if (pg_family)
+			app_ptr = mm_xcalloc(pg_family, 1);
+		if (app_ptr && mm_cpu_caches_on)
+			mm_cpu_cache_refill(pg_family);
+	}
+	mm_unlock();
+	mm_lat_end(MM_LAT_XCALLOC, pg_family, lat_start);
+	return app_ptr;
+}
+
+/*Called with the lock held*/
+static void mm_xfree(block_meta_data_t *block_meta_data)
+{
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+
+	/*probe mm:xfree(struct_name, block_size, app_ptr), struct_name is
+		NULL for an xmalloc bigger than a page*/
+	MM_PROBE3(xfree,
+			  hosting_page->pg_family ? hosting_page->pg_family->struct_name : NULL,
+			  block_meta_data->block_size, block_meta_data + 1);
+
+	if (!hosting_page->pg_family)
+	{
+		mm_xfree_large(hosting_page);
+		return;
+	}
+
+	if (mm_adaptive_strategy)
+		hosting_page->pg_family->window_frees++;
+
+	if (!mm_defer_free_block(block_meta_data))
+		mm_free_blocks(block_meta_data);
+}
+
+/*Family of a relocatable object, NULL for any other object*/
+static vm_page_family_t *mm_relocatable_family_of(void *app_ptr)
+{
+	mm_relocatable_header_t *header = (mm_relocatable_header_t *)app_ptr - 1;
+
+	if (header->tag != MM_RELOCATABLE_TAG)
+		return NULL;
+
+	block_meta_data_t *block_meta_data = (block_meta_data_t *)header - 1;
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+
+	return hosting_page->pg_family;
+}
+
+void xfree(void *app_ptr)
+{
+	block_meta_data_t *block_meta_data =
+		(block_meta_data_t *)((char *)app_ptr - sizeof(block_meta_data_t));
+	vm_page_family_t *relocatable_family = mm_relocatable_family_of(app_ptr);
+
+	if (relocatable_family)
+	{
+		printf("Error : Structure %s is relocatable, free it with xfree_handle\n",
+			   relocatable_family->struct_name);
+		return;
+	}
+
+	assert(block_meta_data->is_free == MM_FALSE);
+	assert(block_meta_data->is_deferred == MM_FALSE);
+
+	uint64_t lat_start = mm_lat_begin();
+	vm_page_t *hosting_page = MM_GET_PAGE_FROM_META_BLOCK(block_meta_data);
+	vm_page_family_t *pg_family = hosting_page->pg_family;
+	vm_bool_t cacheable = pg_family &&
+						  __atomic_load_n(&pg_family->cpu_caches, __ATOMIC_ACQUIRE) &&
+						  block_meta_data->block_size == pg_family->struct_size;
+
+	/*Fast path : park the block in the cache of the CPU, no lock*/
+	if (cacheable && mm_cpu_cache_push(pg_family, block_meta_data))
+	{
+		MM_PROBE3(xfree, pg_family->struct_name, pg_family->struct_size, app_ptr);
+		mm_lat_end(MM_LAT_XFREE, pg_family, lat_start);
+		return;
+	}
+
+	mm_lock();
+	mm_xfree(block_meta_data);
+	if (cacheable)
+		mm_cpu_cache_spill(pg_family);
+	mm_unlock();
+	mm_lat_end(MM_LAT_XFREE, pg_family, lat_start);
+}
+
+/*Bind, registering it on first use, the relocatable family of objects
+	of struct_size bytes*/
+vm_page_family_t *mm_relocatable_family_bind(char *struct_name, uint32_t struct_size)
+{
+	uint32_t full_size = struct_size + sizeof(mm_relocatable_header_t);
+
+	/*One lock hold, as mm_page_family_bind()*/
+	mm_lock();
+	vm_page_family_t *pg_family = lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		mm_instantiate_new_page_family(struct_name, full_size);
+		pg_family = lookup_page_family_by_name(struct_name);
+		if (pg_family)
+			pg_family->relocatable = MM_TRUE;
+	}
+	mm_unlock();
+
+	if (pg_family && (!pg_family->relocatable || pg_family->struct_size != full_size))
+	{
+		printf("Error : Structure %s is not registered as relocatable with size %u\n",
+			   struct_name, struct_size);
+		return NULL;
+	}
+
+	return pg_family;
+}
+
+uint32_t xcalloc_handle(vm_page_family_t *pg_family)
+{
+	uint64_t lat_start = mm_lat_begin();
+	uint32_t index = 0;
+
+	mm_lock();
+	mm_relocatable_header_t *header = mm_xcalloc(pg_family, 1);
+
+	if (header &&
+		!mm_directory_insert(&pg_family->object_directory, MM_RELOCATABLE_MAX_OBJECTS,
+							 (uintptr_t)(header + 1), &index))
+	{
+		printf("Error : %s() object directory of %s is full\n",
+			   __FUNCTION__, pg_family->struct_name);
+		mm_xfree((block_meta_data_t *)header - 1);
+		header = NULL;
+	}
+
+	if (header)
+	{
+		header->handle = index + 1;
+		header->tag = MM_RELOCATABLE_TAG;
+	}
+	mm_unlock();
+	mm_lat_end(MM_LAT_XCALLOC, pg_family, lat_start);
+	return header ? header->handle : 0;
+}
+
+void *mm_relocatable_ptr(vm_page_family_t *pg_family, uint32_t handle)
+{
+	if (!handle)
+		return NULL;
+
+	mm_page_directory_t *directory =
+		__atomic_load_n(&pg_family->object_directory, __ATOMIC_ACQUIRE);
+
+	return (void *)__atomic_load_n(&directory->entries[handle - 1], __ATOMIC_ACQUIRE);
+}
+
+void xfree_handle(vm_page_family_t *pg_family, uint32_t handle)
+{
+	if (!handle)
+		return;
+
+	uint64_t lat_start = mm_lat_begin();
+
+	mm_lock();
+	mm_relocatable_header_t *header =
+		(mm_relocatable_header_t *)pg_family->object_directory->entries[handle - 1] - 1;
+
+	assert(header->handle == handle);
+	mm_directory_remove(pg_family->object_directory, handle - 1);
+	mm_xfree((block_meta_data_t *)header - 1);
+	mm_unlock();
+	mm_lat_end(MM_LAT_XFREE, pg_family, lat_start);
+}
+
+static int mm_compact_page_comparison(const void *page1, const void *page2)
+{
+	uint32_t live1 = ((mm_compact_page_t *)page1)->live;
+	uint32_t live2 = ((mm_compact_page_t *)page2)->live;
+
+	return live1 < live2 ? -1 : live1 > live2;
+}
+
+/*Compaction only fills the free blocks already on the free block list :
+	no page is added, bumped or carved into slots*/
+static block_meta_data_t *mm_compact_allocate(vm_page_family_t *vm_page_family)
+{
+	block_meta_data_t *biggest_block_meta_data =
+		mm_get_biggest_free_block_page_family(vm_page_family);
+
+	if (!biggest_block_meta_data ||
+		biggest_block_meta_data->block_size < vm_page_family->struct_size)
+		return NULL;
+
+	if (!mm_split_free_data_block_for_allocation(vm_page_family, biggest_block_meta_data,
+												 vm_page_family->struct_size))
+		return NULL;
+
+	return biggest_block_meta_data;
+}
+
+/*Move the live objects of a source page of compaction to the pages
+	left on the free block list and give the page back. When they run
+	out of room the page keeps the objects not moved yet*/
+static vm_bool_t mm_compact_vm_page(vm_page_family_t *vm_page_family, vm_page_t *vm_page)
+{
+	block_meta_data_t *curr = NULL;
+	block_meta_data_t *new_block = NULL;
+	glthread_t moved, *glue = NULL;
+
+	ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(vm_page, curr)
+	{
+		if (curr->is_free || (vm_page->color && curr == &vm_page->block_meta_data))
+			continue;
+
+		new_block = mm_compact_allocate(vm_page_family);
+
+		if (!new_block)
+			break;
+
+		mm_relocatable_header_t *header = (mm_relocatable_header_t *)(curr + 1);
+
+		memcpy(new_block + 1, header, vm_page_family->struct_size);
+		__atomic_store_n(&vm_page_family->object_directory->entries[header->handle - 1],
+						 (uintptr_t)((mm_relocatable_header_t *)(new_block + 1) + 1),
+						 __ATOMIC_RELEASE);
+		curr->is_deferred = MM_TRUE; /*moved out*/
+	}
+	ITERATE_VM_PAGE_ALL_BLOCKS_END(vm_page, curr);
+
+	if (new_block)
+	{
+		mm_vm_page_delete_and_free(vm_page);
+		return MM_TRUE;
+	}
+
+	/*Out of room : the page goes back to normal. Moved blocks are
+		collected first, freeing them merges the headers a page walk
+		would go through*/
+	init_glthread(&moved);
+	ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(vm_page, curr)
+	{
+		if (curr->is_free)
+			mm_add_free_block_meta_data_to_free_block_list(vm_page_family, curr);
+		else if (curr->is_deferred)
+			glthread_add_next(&moved, &curr->priority_thread_glue);
+	}
+	ITERATE_VM_PAGE_ALL_BLOCKS_END(vm_page, curr);
+
+	ITERATE_GLTHREAD_BEGIN(&moved, glue)
+	{
+		remove_glthread(glue);
+		curr = glthread_to_block_meta_data(glue);
+		curr->is_deferred = MM_FALSE;
+		mm_free_blocks(curr);
+	}
+	ITERATE_GLTHREAD_END(&moved, glue);
+	return MM_FALSE;
+}
+
+uint32_t mm_compact_family(char *struct_name)
+{
+	vm_page_t *vm_page = NULL;
+	block_meta_data_t *curr = NULL;
+	uint32_t pages = 0, released = 0, i, sources;
+	uint32_t total_free_slots = 0, source_free_slots = 0, moved = 0;
+
+	mm_lock();
+
+	vm_page_family_t *pg_family = lookup_page_family_by_name(struct_name);
+
+	if (!pg_family || !pg_family->relocatable)
+	{
+		printf("Error : Structure %s is not registered as relocatable\n", struct_name);
+		mm_unlock();
+		return 0;
+	}
+
+	mm_family_flush_deferred_frees(pg_family);
+	mm_retire_bump_page(pg_family);
+
+	ITERATE_VM_PAGE_BEGIN(pg_family, vm_page)
+	{
+		pages++;
+	}
+	ITERATE_VM_PAGE_END(pg_family, vm_page);
+
+	uint32_t units = (pages * sizeof(mm_compact_page_t) + SYSTEM_PAGE_SIZE - 1) /
+					 SYSTEM_PAGE_SIZE;
+	mm_compact_page_t *compact_pages = pages < 2 || !mm_budget_admit(NULL, units) ?
+										   NULL :
+										   mm_get_new_vm_page_from_kernel(units);
+
+	if (!compact_pages)
+	{
+		mm_unlock();
+		return 0;
+	}
+
+	/*Live objects and free object slots of every page*/
+	i = 0;
+	ITERATE_VM_PAGE_BEGIN(pg_family, vm_page)
+	{
+		compact_pages[i].vm_page = vm_page;
+
+		ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(vm_page, curr)
+		{
+			if (curr->is_free)
+				compact_pages[i].free_slots += (curr->block_size + sizeof(block_meta_data_t)) /
+											   (pg_family->struct_size + sizeof(block_meta_data_t));
+			else if (!vm_page->color || curr != &vm_page->block_meta_data)
+				compact_pages[i].live++;
+		}
+		ITERATE_VM_PAGE_ALL_BLOCKS_END(vm_page, curr);
+		total_free_slots += compact_pages[i++].free_slots;
+	}
+	ITERATE_VM_PAGE_END(pg_family, vm_page);
+
+	/*Empty the sparsest pages into the others for as long as they can
+		take the objects*/
+	qsort(compact_pages, pages, sizeof(mm_compact_page_t), mm_compact_page_comparison);
+
+	for (sources = 0; sources < pages - 1; sources++)
+	{
+		if (moved + compact_pages[sources].live >
+			total_free_slots - source_free_slots - compact_pages[sources].free_slots)
+			break;
+		moved += compact_pages[sources].live;
+		source_free_slots += compact_pages[sources].free_slots;
+	}
+
+	/*Objects must only land in the pages that stay*/
+	for (i = 0; i < sources; i++)
+	{
+		ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(compact_pages[i].vm_page, curr)
+		{
+			if (curr->is_free)
+				remove_glthread(&curr->priority_thread_glue);
+		}
+		ITERATE_VM_PAGE_ALL_BLOCKS_END(compact_pages[i].vm_page, curr);
+	}
+
+	for (i = 0; i < sources && mm_compact_vm_page(pg_family, compact_pages[i].vm_page); i++)
+		released++;
+
+	/*Pages not reached go back to normal*/
+	for (i++; i < sources; i++)
+	{
+		ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(compact_pages[i].vm_page, curr)
+		{
+			if (curr->is_free)
+				mm_add_free_block_meta_data_to_free_block_list(pg_family, curr);
+		}
+		ITERATE_VM_PAGE_ALL_BLOCKS_END(compact_pages[i].vm_page, curr);
+	}
+
+	mm_return_vm_page_to_kernel((void *)compact_pages, units);
+	mm_unlock();
+	return released;
+}
+
+/*Add a fresh page from kernel to the head of arena page list*/
+static vm_bool_t mm_arena_new_page_add(mm_arena_t *arena)
+{
+	if (!mm_budget_admit(NULL, 1))
+		return MM_FALSE;
+
+	mm_arena_page_t *arena_page = mm_get_new_vm_page_from_kernel(1);
+
+	if (!arena_page)
+		return MM_FALSE;
+
+	arena_page->next = arena->first_page;
+	arena->first_page = arena_page;
+	arena->free_ptr = arena_page->page_memory;
+	arena->end_ptr = (char *)arena_page + SYSTEM_PAGE_SIZE;
+	arena->page_count++;
+	return MM_TRUE;
+}
+
+mm_arena_t *mm_arena_create()
+{
+	mm_lock();
+	mm_arena_page_t *arena_page = mm_budget_admit(NULL, 1) ? mm_get_new_vm_page_from_kernel(1) : NULL;
+	mm_unlock();
+
+	if (!arena_page)
+		return NULL;
+
+	/*Arena descriptor itself lives at the start of its first page*/
+	arena_page->next = NULL;
+	mm_arena_t *arena = (mm_arena_t *)arena_page->page_memory;
+	arena->first_page = arena_page;
+	arena->free_ptr = (char *)arena + MM_ARENA_ALIGN(sizeof(mm_arena_t));
+	arena->end_ptr = (char *)arena_page + SYSTEM_PAGE_SIZE;
+	arena->page_count = 1;
+	return arena;
+}
+
+void *xcalloc_in(mm_arena_t *arena, char *struct_name, int units)
+{
+	mm_lock();
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+	mm_unlock();
+
+	if (!pg_family)
+	{
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+		return NULL;
+	}
+
+	uint32_t req_size = MM_ARENA_ALIGN(units * pg_family->struct_size);
+
+	if (req_size > SYSTEM_PAGE_SIZE - offset_of(mm_arena_page_t, page_memory))
+	{
+		printf("Error : Memory Requested exceeds page size\n");
+		return NULL;
+	}
+
+	if ((size_t)(arena->end_ptr - arena->free_ptr) < req_size)
+	{
+		/*Tail of the current page is abandoned, it is
+			reclaimed when the arena is destroyed*/
+		mm_lock();
+		vm_bool_t status = mm_arena_new_page_add(arena);
+		mm_unlock();
+
+		if (!status)
+			return NULL;
+	}
+
+	/*Arena pages are never reused before being returned to kernel,
+		so memory handed out here is still zero filled from mmap*/
+	void *app_ptr = arena->free_ptr;
+	arena->free_ptr += req_size;
+	return app_ptr;
+}
+
+void mm_arena_destroy(mm_arena_t *arena)
+{
+	mm_arena_page_t *arena_page = arena->first_page;
+	mm_arena_page_t *next = NULL;
+
+	mm_lock();
+	/*Page holding the arena descriptor is the last one in the list*/
+	for (; arena_page; arena_page = next)
+	{
+		next = arena_page->next;
+		mm_return_vm_page_to_kernel((void *)arena_page, 1);
+	}
+	mm_unlock();
+}
+
+void mm_set_deferred_free(char *struct_name, uint32_t max_deferred)
+{
+	mm_lock();
+
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+	{
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+		mm_unlock();
+		return;
+	}
+
+	pg_family->max_deferred = max_deferred;
+	if (pg_family->deferred_count > mm_family_max_deferred(pg_family))
+		mm_family_flush_deferred_frees(pg_family);
+	mm_unlock();
+}
+
+void mm_adaptive_strategy_enable(int enable)
+{
+	vm_page_for_families_t *vm_page_for_families = NULL;
+	vm_page_family_t *vm_page_family_curr = NULL;
+
+	mm_lock();
+	mm_adaptive_strategy = enable ? MM_TRUE : MM_FALSE;
+
+	for (vm_page_for_families = first_vm_page_for_families;
+		 vm_page_for_families;
+		 vm_page_for_families = vm_page_for_families->next)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families, vm_page_family_curr)
+		{
+			if (!enable)
+				mm_family_set_strategy(vm_page_family_curr, MM_STRATEGY_GENERAL);
+			vm_page_family_curr->window_allocs = 0;
+			vm_page_family_curr->window_single_allocs = 0;
+			vm_page_family_curr->window_frees = 0;
+			vm_page_family_curr->window_bulk_frees = 0;
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families, vm_page_family_curr);
+	}
+	mm_unlock();
+}
+
+mm_strategy_t mm_get_family_strategy(char *struct_name)
+{
+	mm_strategy_t strategy = MM_STRATEGY_GENERAL;
+
+	mm_lock();
+
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+	else
+		strategy = (mm_strategy_t)pg_family->strategy;
+
+	mm_unlock();
+	return strategy;
+}
+
+int mm_cpu_cache_enable()
+{
+#ifdef MM_RSEQ
+	mm_lock();
+
+	if (mm_cpu_caches_on)
+	{
+		mm_unlock();
+		return 0;
+	}
+
+	/*Caches are process local, the shared and persistent heaps are not.
+		rseq may be unavailable to glibc, or turned off by its tunable*/
+	if (shared_heap || !__rseq_size || (int32_t)mm_rseq_area()->cpu_id < 0 ||
+		syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0))
+	{
+		mm_unlock();
+		return -1;
+	}
+
+	mm_cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+	mm_unlock();
+
+	mm_thread_safe_enable();
+	mm_cpu_caches_on = MM_TRUE;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void mm_flush_deferred_frees()
+{
+	vm_page_family_t *vm_page_family_curr = NULL;
+	vm_page_for_families_t *vm_page_for_families_curr = NULL;
+
+	mm_lock();
+	for (vm_page_for_families_curr = first_vm_page_for_families;
+		 vm_page_for_families_curr;
+		 vm_page_for_families_curr = vm_page_for_families_curr->next)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families_curr, vm_page_family_curr)
+		{
+			mm_family_drain_cpu_caches(vm_page_family_curr, MM_TRUE);
+			if (vm_page_family_curr->deferred_count)
+				mm_family_flush_deferred_frees(vm_page_family_curr);
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families_curr, vm_page_family_curr);
+	}
+	mm_unlock();
+}
+
+/*An exiting thread unregisters its record, reclamation stops looking
+	at it*/
+static void mm_epoch_thread_exit(void *arg)
+{
+	mm_epoch_thread_t *self = arg;
+	mm_epoch_thread_t **prev_next = NULL;
+
+	pthread_mutex_lock(&mm_epoch_mutex);
+	for (prev_next = &mm_epoch_threads; *prev_next; prev_next = &(*prev_next)->next)
+	{
+		if (*prev_next == self)
+		{
+			*prev_next = self->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mm_epoch_mutex);
+
+	mm_epoch_self = NULL;
+	free(self);
+}
+
+static void mm_epoch_thread_key_create()
+{
+	pthread_key_create(&mm_epoch_thread_key, mm_epoch_thread_exit);
+}
+
+static mm_epoch_thread_t *mm_epoch_thread_self()
+{
+	if (mm_epoch_self)
+		return mm_epoch_self;
+
+	mm_epoch_thread_t *self = calloc(1, sizeof(mm_epoch_thread_t));
+	assert(self);
+
+	pthread_once(&mm_epoch_thread_key_once, mm_epoch_thread_key_create);
+
+	pthread_mutex_lock(&mm_epoch_mutex);
+	self->next = mm_epoch_threads;
+	mm_epoch_threads = self;
+	pthread_mutex_unlock(&mm_epoch_mutex);
+
+	pthread_setspecific(mm_epoch_thread_key, self);
+	mm_epoch_self = self;
+	return self;
+}
+
+void mm_epoch_enter()
+{
+	mm_epoch_thread_t *self = mm_epoch_thread_self();
+
+	if (self->nesting++)
+		return;
+
+	uint64_t epoch = __atomic_load_n(&mm_epoch_global, __ATOMIC_ACQUIRE);
+	/*Announced before any shared pointer is read*/
+	__atomic_store_n(&self->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+}
+
+void mm_epoch_exit()
+{
+	mm_epoch_thread_t *self = mm_epoch_self;
+
+	assert(self && self->nesting);
+	if (--self->nesting)
+		return;
+
+	__atomic_store_n(&self->state, 0, __ATOMIC_RELEASE);
+}
+
+/*Called with mm_epoch_mutex held. Advances the global epoch when every
+	reader inside a read section entered in the current one, then moves
+	the objects retired two epochs ago onto reclaimed*/
+static vm_bool_t mm_epoch_try_advance(glthread_t *reclaimed)
+{
+	mm_epoch_thread_t *thread = NULL;
+	uint64_t epoch = mm_epoch_global;
+
+	mm_epoch_retired = 0;
+
+	for (thread = mm_epoch_threads; thread; thread = thread->next)
+	{
+		uint64_t state = __atomic_load_n(&thread->state, __ATOMIC_SEQ_CST);
+
+		if ((state & 1) && (state >> 1) != epoch)
+			return MM_FALSE;
+	}
+
+	__atomic_store_n(&mm_epoch_global, epoch + 1, __ATOMIC_RELEASE);
+
+	glthread_t *limbo = &mm_epoch_limbo[(epoch + 1) % MM_EPOCH_LIMBO_LISTS];
+
+	reclaimed->right = limbo->right;
+	if (reclaimed->right)
+		reclaimed->right->left = reclaimed;
+	init_glthread(limbo);
+	return MM_TRUE;
+}
+
+/*Called with the lock held, return a batch of reclaimed objects to their
+	families in one go*/
+static void mm_epoch_free_reclaimed(glthread_t *reclaimed)
+{
+	glthread_t *curr = NULL;
+
+	ITERATE_GLTHREAD_BEGIN(reclaimed, curr)
+	{
+		remove_glthread(curr);
+		mm_xfree(glthread_to_block_meta_data(curr));
+	}
+	ITERATE_GLTHREAD_END(reclaimed, curr);
+}
+
+void xfree_deferred(void *app_ptr)
+{
+	block_meta_data_t *block_meta_data =
+		(block_meta_data_t *)((char *)app_ptr - sizeof(block_meta_data_t));
+	vm_page_family_t *relocatable_family = mm_relocatable_family_of(app_ptr);
+	vm_bool_t batch_full = MM_FALSE;
+
+	if (relocatable_family)
+	{
+		printf("Error : Structure %s is relocatable, free it with xfree_handle\n",
+			   relocatable_family->struct_name);
+		return;
+	}
+
+	assert(block_meta_data->is_free == MM_FALSE);
+	assert(block_meta_data->is_deferred == MM_FALSE);
+
+	/*Limbo lists and reader records are process local, they must not
+		hold objects of a heap other processes or later runs use*/
+	if (shared_heap)
+	{
+		printf("Error : %s() is only available with a private heap\n", __FUNCTION__);
+		return;
+	}
+
+	mm_thread_safe_enable();
+
+	/*The glue of an allocated block is unused, it links the limbo list*/
+	pthread_mutex_lock(&mm_epoch_mutex);
+	glthread_add_next(&mm_epoch_limbo[mm_epoch_global % MM_EPOCH_LIMBO_LISTS],
+					  &block_meta_data->priority_thread_glue);
+	batch_full = ++mm_epoch_retired >= MM_EPOCH_RECLAIM_BATCH;
+	pthread_mutex_unlock(&mm_epoch_mutex);
+
+	if (batch_full)
+		mm_epoch_reclaim();
+}
+
+uint32_t mm_epoch_reclaim()
+{
+	glthread_t reclaimed;
+	uint32_t count = 0;
+
+	init_glthread(&reclaimed);
+
+	/*The lock is taken first and held until the batch is freed : a bulk
+		release purging the limbo lists cannot miss objects in flight*/
+	mm_lock();
+	pthread_mutex_lock(&mm_epoch_mutex);
+	if (mm_epoch_try_advance(&reclaimed))
+		count = get_glthread_list_count(&reclaimed);
+	pthread_mutex_unlock(&mm_epoch_mutex);
+
+	mm_epoch_free_reclaimed(&reclaimed);
+	mm_unlock();
+	return count;
+}
+
+void mm_set_memory_budget(size_t soft_limit, size_t hard_limit)
+{
+	mm_lock();
+	mm_budget.soft_limit_pages = soft_limit / SYSTEM_PAGE_SIZE;
+	mm_budget.hard_limit_pages = (hard_limit + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+	mm_unlock();
+}
+
+void mm_set_family_budget(char *struct_name, size_t hard_limit)
+{
+	mm_lock();
+
+	vm_page_family_t *pg_family =
+		lookup_page_family_by_name(struct_name);
+
+	if (!pg_family)
+		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
+	else
+		pg_family->max_pages = (hard_limit + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE;
+
+	mm_unlock();
+}
+
+void mm_set_pressure_callback(void (*pressure_cb)(char *struct_name,
+												  size_t requested_bytes))
+{
+	mm_lock();
+	mm_budget.pressure_cb = pressure_cb;
+	mm_unlock();
+}
+
+size_t mm_resident_bytes()
+{
+	return (mm_budget.pages_in_use + mm_budget.pages_retained) * SYSTEM_PAGE_SIZE;
+}
+
+/*Called with the lock held. Give back the system pages lying wholly
+	inside the free blocks of a VM data page spanning several of them,
+	they stay mapped and read as zeros when touched again*/
+static uint32_t mm_purge_span_page(vm_page_family_t *vm_page_family, vm_page_t *vm_page)
+{
+	block_meta_data_t *curr = NULL;
+	uint32_t purged = 0;
+
+	ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(vm_page, curr)
+	{
+		if (!curr->is_free || curr->is_deferred)
+			continue;
+
+		uintptr_t start = ((uintptr_t)(curr + 1) + SYSTEM_PAGE_SIZE - 1) & ~(SYSTEM_PAGE_SIZE - 1);
+		uintptr_t end = ((uintptr_t)(curr + 1) + curr->block_size) & ~(SYSTEM_PAGE_SIZE - 1);
+
+		if (end > start && !madvise((void *)start, end - start, MADV_DONTNEED))
+			purged += (end - start) / SYSTEM_PAGE_SIZE;
+	}
+	ITERATE_VM_PAGE_ALL_BLOCKS_END(vm_page, curr);
+
+	vm_page->purged = MM_TRUE;
+	return purged;
+}
+
+/*Give back at most max_pages retained pages, only as many as needed
+	to bring usage back to the soft limit, then the free system pages
+	inside the VM data pages of families spanning several*/
+uint32_t mm_scavenge(uint32_t max_pages)
+{
+	uint32_t released = 0;
+	vm_page_t *vm_page = NULL;
+	vm_page_for_families_t *vm_page_for_families_curr = NULL;
+	vm_page_family_t *vm_page_family_curr = NULL;
+
+	mm_lock();
+	while (released < max_pages && mm_budget.retained_pages &&
+		   mm_budget.pages_in_use + mm_budget.pages_retained > mm_budget.soft_limit_pages)
+	{
+		vm_page = mm_budget.retained_pages;
+		mm_budget.retained_pages = vm_page->next;
+		mm_budget.pages_retained--;
+		mm_budget.pages_in_use++; /*accounted back by the return below*/
+		mm_return_vm_page_to_kernel((void *)vm_page, 1);
+		released++;
+	}
+
+	/*Pages of the shared segment are not the process's to give back.
+		The bump page is skipped, its untouched tail was never used*/
+	if (shared_heap ||
+		mm_budget.pages_in_use + mm_budget.pages_retained <= mm_budget.soft_limit_pages)
+	{
+		mm_unlock();
+		return released;
 	}
 
-	/*case 2 : Sull Split : New Meta block is created*/
-	else
+	for (vm_page_for_families_curr = first_vm_page_for_families;
+		 vm_page_for_families_curr && released < max_pages;
+		 vm_page_for_families_curr = vm_page_for_families_curr->next)
 	{
-		/*New Meta block is to be created*/
-		next_block_meta_data = NEXT_META_BLOCK_BY_SIZE(block_meta_data);
-		next_block_meta_data->is_free = MM_TRUE;
-		next_block_meta_data->block_size = remaining_size - sizeof(block_meta_data_t);
-		next_block_meta_data->offset = block_meta_data->offset + sizeof(block_meta_data_t) + block_meta_data->block_size;
-		init_glthread(&next_block_meta_data->priority_thread_glue);
-		mm_add_free_block_meta_data_to_free_block_list(
-			vm_page_family, next_block_meta_data);
-		mm_bind_blocks_for_allocation(block_meta_data, next_block_meta_data);
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families_curr, vm_page_family_curr)
+		{
+			if (vm_page_family_curr->span_pages < 2)
+				continue;
+
+			ITERATE_VM_PAGE_BEGIN(vm_page_family_curr, vm_page)
+			{
+				if (released < max_pages && !vm_page->purged &&
+					vm_page != vm_page_family_curr->bump_page)
+					released += mm_purge_span_page(vm_page_family_curr, vm_page);
+			}
+			ITERATE_VM_PAGE_END(vm_page_family_curr, vm_page);
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families_curr, vm_page_family_curr);
 	}
+	mm_unlock();
 
-	return MM_TRUE;
+	return released;
 }
 
-static vm_page_t *mm_family_new_page_add(vm_page_family_t *vm_page_family)
+/*Scavenging is done in small steps, each holding the lock only for
+	pages_per_step page returns, so allocating threads are not stalled*/
+static void mm_thread_safe_init()
 {
+	pthread_mutexattr_t mutex_attr;
 
-	vm_page_t *vm_page = allocate_vm_page(vm_page_family);
-
-	if (!vm_page)
-		return NULL;
-
-	/* The new page is like one free block, add it to the
-	 * free block list*/
-	mm_add_free_block_meta_data_to_free_block_list(
-		vm_page_family, &vm_page->block_meta_data);
-
-	return vm_page;
+	pthread_mutexattr_init(&mutex_attr);
+	pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mm_local_mutex, &mutex_attr);
+	pthread_mutexattr_destroy(&mutex_attr);
+	mm_thread_safe = MM_TRUE;
 }
 
-static block_meta_data_t *mm_allocate_free_data_block(
-	vm_page_family_t *vm_page_family,
-	uint32_t req_size)
+void mm_thread_safe_enable()
 {
+	pthread_once(&mm_thread_safe_once, mm_thread_safe_init);
+}
 
-	vm_bool_t status = MM_FALSE;
-	vm_page_t *vm_page = NULL;
-	block_meta_data_t *block_meta_data = NULL;
+static void *mm_scavenger_fn(void *arg)
+{
+	struct timespec interval;
 
-	block_meta_data_t *biggest_block_meta_data = mm_get_biggest_free_block_page_family(vm_page_family);
+	interval.tv_sec = mm_scavenger_interval_ms / 1000;
+	interval.tv_nsec = (mm_scavenger_interval_ms % 1000) * 1000000L;
 
-	if (!biggest_block_meta_data ||
-		biggest_block_meta_data->block_size < req_size)
+	while (mm_scavenger_running)
 	{
-		/*Time to add a new page to Page family to satisfy the request*/
-		vm_page = mm_family_new_page_add(vm_page_family);
+		nanosleep(&interval, NULL);
 
-		/*Allocate the free block from this page now*/
-		status = mm_split_free_data_block_for_allocation(vm_page_family,
-														 &vm_page->block_meta_data, req_size);
-
-		if (status)
-			return &vm_page->block_meta_data;
+		/*Periodic sweep of the blocks parked by deferred coalescing
+			and of the retired objects readers are done with*/
+		mm_flush_deferred_frees();
+		mm_epoch_reclaim();
 
-		return NULL;
+		while (mm_scavenger_running &&
+			   mm_scavenge(mm_scavenger_pages_per_step) == mm_scavenger_pages_per_step)
+			;
 	}
+	return NULL;
+}
 
-	/*The biggest block meta data can satisfy the request*/
-	if (biggest_block_meta_data)
+int mm_scavenger_start(uint32_t interval_ms, uint32_t pages_per_step)
+{
+	if (mm_scavenger_running)
+		return 0;
+
+	mm_thread_safe_enable();
+
+	mm_scavenger_interval_ms = interval_ms ? interval_ms : 1;
+	mm_scavenger_pages_per_step = pages_per_step ? pages_per_step : 1;
+	mm_scavenger_running = MM_TRUE;
+
+	if (pthread_create(&mm_scavenger_thread, NULL, mm_scavenger_fn, NULL))
 	{
-		status = mm_split_free_data_block_for_allocation(vm_page_family,
-														 biggest_block_meta_data, req_size);
+		printf("Error : %s() could not start scavenger thread\n", __FUNCTION__);
+		mm_scavenger_running = MM_FALSE;
+		return -1;
 	}
+	return 0;
+}
 
-	if (status)
-		return biggest_block_meta_data;
+void mm_scavenger_stop()
+{
+	if (!mm_scavenger_running)
+		return;
 
-	return NULL;
+	mm_scavenger_running = MM_FALSE;
+	pthread_join(mm_scavenger_thread, NULL);
 }
 
-static block_meta_data_t *mm_free_blocks(
-	block_meta_data_t *to_be_free_block)
+void mm_set_verify_callback(void (*verify_cb)(char *struct_name, void *vm_page,
+											  void *block, char *problem))
 {
-	block_meta_data_t *return_block = NULL;
+	mm_verify_cb = verify_cb;
+}
 
-	assert(to_be_free_block->is_free == MM_FALSE);
+static uint32_t mm_verify_report(vm_page_family_t *vm_page_family, vm_page_t *vm_page,
+								 block_meta_data_t *block_meta_data, char *problem)
+{
+	if (mm_verify_cb)
+		mm_verify_cb(vm_page_family->struct_name, vm_page, block_meta_data, problem);
+	else
+		printf("Error : heap check : %s, page %p, block %p : %s\n",
+			   vm_page_family->struct_name, vm_page, block_meta_data, problem);
+	return 1;
+}
 
-	vm_page_t *hosting_page =
-		MM_GET_PAGE_FROM_META_BLOCK(to_be_free_block);
+/*Checks of one VM data page, each only looks at a block and its
+	neighbours in the page and in the lists it is queued on*/
+static uint32_t mm_verify_vm_page(vm_page_family_t *vm_page_family, vm_page_t *vm_page)
+{
+	block_meta_data_t *block_meta_data = NULL;
+	block_meta_data_t *prev_block = NULL;
+	char *page_end = (char *)vm_page + vm_page_family->span_pages * SYSTEM_PAGE_SIZE;
+	uint32_t problems = 0;
 
-	vm_page_family_t *vm_page_family = hosting_page->pg_family;
+	if (vm_page->pg_family != vm_page_family)
+		return mm_verify_report(vm_page_family, vm_page, NULL, "page family back pointer");
 
-	return_block = to_be_free_block;
+	for (block_meta_data = &vm_page->block_meta_data; block_meta_data;
+		 prev_block = block_meta_data, block_meta_data = block_meta_data->next_block)
+	{
+		block_meta_data_t *next_block = block_meta_data->next_block;
+		char *block_end = (char *)NEXT_META_BLOCK_BY_SIZE(block_meta_data);
 
-	to_be_free_block->is_free = MM_TRUE;
+		if ((char *)block_meta_data < (char *)vm_page || (char *)block_meta_data >= page_end)
+			return problems + mm_verify_report(vm_page_family, vm_page, block_meta_data,
+											   "block outside its page");
 
-	block_meta_data_t *next_block = NEXT_META_BLOCK(to_be_free_block);
+		if (block_meta_data->prev_block != prev_block)
+			problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+										 "prev_block link");
 
-	/*Handing Hard IF memory*/
-	if (next_block)
-	{
-		/*Scenario 1 : When data block to be freed is not the last
-			upper most meta block in a VM data page*/
-		to_be_free_block->block_size +=
-			mm_get_hard_internal_memory_frag_size(to_be_free_block, next_block);
+		if (block_meta_data->offset != (char *)block_meta_data - (char *)vm_page)
+			problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+										 "offset");
+
+		if (block_end > page_end ||
+			(next_block && ((char *)next_block < block_end ||
+							(char *)next_block - block_end >= sizeof(block_meta_data_t))))
+		{
+			/*Do not follow a next_block link that cannot be right*/
+			return problems + mm_verify_report(vm_page_family, vm_page, block_meta_data,
+											   "block size or next_block link");
+		}
+
+		if (block_meta_data->is_free)
+		{
+			glthread_t *glue = &block_meta_data->priority_thread_glue;
+
+			if (block_meta_data->is_deferred || !glue->left ||
+				glue->left->right != glue || (glue->right && glue->right->left != glue))
+				problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+											 "free block not on the free block list");
+			else if (glue->left != &vm_page_family->free_block_priority_list_head &&
+					 glthread_to_block_meta_data(glue->left)->block_size <
+						 block_meta_data->block_size)
+				problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+											 "free block list order");
+
+			if (next_block && next_block->is_free)
+				problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+											 "adjacent free blocks not merged");
+		}
+		else if (block_meta_data->is_deferred &&
+				 !IS_QUEUED_UP_IN_THREAD(&block_meta_data->priority_thread_glue))
+		{
+			problems += mm_verify_report(vm_page_family, vm_page, block_meta_data,
+										 "deferred block not on the deferred list");
+		}
 	}
-	else
+
+	return problems;
+}
+
+/*Family at ordinal position in the registry, NULL past the last one*/
+static vm_page_family_t *mm_verify_family_at(uint32_t ordinal)
+{
+	vm_page_for_families_t *vm_page_for_families = NULL;
+	vm_page_family_t *vm_page_family = NULL;
+
+	for (vm_page_for_families = first_vm_page_for_families; vm_page_for_families;
+		 vm_page_for_families = vm_page_for_families->next)
 	{
-		/* Scenario 2 : Page Boundry condition*/
-		/* Block being freed is the upper most free data block
-			in a VM data page, check of hard internal fragmented
-			memory and merge*/
-		char *end_address_of_vm_page = (char *)((char *)hosting_page + SYSTEM_PAGE_SIZE);
-		char *end_address_of_free_data_block =
-			(char *)(to_be_free_block + 1) + to_be_free_block->block_size;
-		int internal_mem_fragmentation = (int)((unsigned long)end_address_of_vm_page -
-											   (unsigned long)end_address_of_free_data_block);
-		to_be_free_block->block_size += internal_mem_fragmentation;
+		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families, vm_page_family)
+		{
+			if (!ordinal--)
+				return vm_page_family;
+		}
+		ITERATE_PAGE_FAMILIES_END(vm_page_for_families, vm_page_family);
 	}
+	return NULL;
+}
 
-	/*Now perform Mergin*/
-	if (next_block && next_block->is_free == MM_TRUE)
+uint32_t mm_verify_step(uint32_t max_pages)
+{
+	uint32_t problems = 0;
+	uint32_t pages = 0;
+
+	mm_lock();
+	while (pages < max_pages)
 	{
-		/*Union two free blocks*/
-		mm_union_free_blocks(to_be_free_block, next_block);
-		return_block = to_be_free_block;
+		vm_page_family_t *vm_page_family = mm_verify_family_at(mm_verify_family_ordinal);
+
+		if (!vm_page_family)
+		{
+			/*Full pass done, the next step starts over*/
+			mm_verify_family_ordinal = 0;
+			mm_verify_page_index = 0;
+			break;
+		}
+
+		mm_page_directory_t *directory = vm_page_family->page_directory;
+
+		if (!directory || mm_verify_page_index >= directory->used)
+		{
+			mm_verify_family_ordinal++;
+			mm_verify_page_index = 0;
+			continue;
+		}
+
+		uintptr_t entry = directory->entries[mm_verify_page_index++];
+
+		if (entry & 1)
+			continue;
+
+		problems += mm_verify_vm_page(vm_page_family, (vm_page_t *)entry);
+		pages++;
 	}
+	mm_unlock();
 
-	/*Check the previous block if it was free*/
-	block_meta_data_t *prev_block = PREV_META_BLOCK(to_be_free_block);
+	return problems;
+}
 
-	if (prev_block && prev_block->is_free)
+static void *mm_verifier_fn(void *arg)
+{
+	struct timespec interval;
+
+	interval.tv_sec = mm_verifier_interval_ms / 1000;
+	interval.tv_nsec = (mm_verifier_interval_ms % 1000) * 1000000L;
+
+	while (mm_verifier_running)
 	{
-		mm_union_free_blocks(prev_block, to_be_free_block);
-		return_block = prev_block;
+		nanosleep(&interval, NULL);
+		mm_verify_step(mm_verifier_pages_per_step);
 	}
+	return NULL;
+}
 
-	if (mm_is_vm_page_empty(hosting_page))
+int mm_verifier_start(uint32_t interval_ms, uint32_t pages_per_step)
+{
+	if (mm_verifier_running)
+		return 0;
+
+	mm_thread_safe_enable();
+
+	mm_verifier_interval_ms = interval_ms ? interval_ms : 1;
+	mm_verifier_pages_per_step = pages_per_step ? pages_per_step : 1;
+	mm_verifier_running = MM_TRUE;
+
+	if (pthread_create(&mm_verifier_thread, NULL, mm_verifier_fn, NULL))
 	{
-		mm_vm_page_delete_and_free(hosting_page);
-		return NULL;
+		printf("Error : %s() could not start verifier thread\n", __FUNCTION__);
+		mm_verifier_running = MM_FALSE;
+		return -1;
 	}
-	mm_add_free_block_meta_data_to_free_block_list(
-		hosting_page->pg_family, return_block);
-
-	return return_block;
+	return 0;
 }
 
-static int mm_get_hard_internal_memory_frag_size(
-	block_meta_data_t *first,
-	block_meta_data_t *second)
+void mm_verifier_stop()
 {
-	block_meta_data_t *next_block = NEXT_META_BLOCK_BY_SIZE(first);
-	return (int)((unsigned long)second - (unsigned long)next_block);
+	if (!mm_verifier_running)
+		return;
+
+	mm_verifier_running = MM_FALSE;
+	pthread_join(mm_verifier_thread, NULL);
 }
 
-static void mm_union_free_blocks(block_meta_data_t *first,
-								 block_meta_data_t *second)
+void mm_latency_stats_enable(int enable)
 {
-	assert(first->is_free == MM_TRUE &&
-		   second->is_free == MM_TRUE);
+	if (enable && !mm_lat_enabled)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		/*Calibrate TSC ticks against the monotonic clock*/
+		struct timespec ts_start, ts_end, pause = {0, 10000000L};
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+		uint64_t tsc_start = mm_lat_now();
+		nanosleep(&pause, NULL);
+		uint64_t tsc_end = mm_lat_now();
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
 
-	first->block_size += sizeof(block_meta_data_t) + second->block_size;
+		double elapsed_ns = (ts_end.tv_sec - ts_start.tv_sec) * 1e9 +
+							(ts_end.tv_nsec - ts_start.tv_nsec);
+		mm_lat_ns_per_tick = elapsed_ns / (double)(tsc_end - tsc_start);
+#endif
+	}
+	mm_lat_enabled = enable ? MM_TRUE : MM_FALSE;
+}
 
-	first->next_block = second->next_block;
+void mm_latency_stats_reset()
+{
+	mm_thread_latency_t *thread_lat = NULL;
 
-	if (second->next_block)
-		second->next_block->prev_block = first;
+	for (thread_lat = __atomic_load_n(&mm_lat_threads, __ATOMIC_ACQUIRE);
+		 thread_lat; thread_lat = thread_lat->next)
+	{
+		memset(thread_lat->by_cause, 0, sizeof(thread_lat->by_cause));
+		memset(thread_lat->by_family, 0, sizeof(thread_lat->by_family));
+	}
 }
 
-vm_page_family_t *lookup_page_family_by_name(char *struct_name)
+/*Sum of one histogram over all threads*/
+static void mm_lat_collect(mm_latency_histogram_t *sum, vm_page_family_t *pg_family,
+						   mm_lat_op_t op, mm_lat_cause_t cause)
 {
-	vm_page_family_t *vm_page_family_curr = NULL;
-	vm_page_for_families_t *vm_page_for_families_curr = NULL;
+	mm_thread_latency_t *thread_lat = NULL;
+	uint32_t stats_index = pg_family ? mm_lat_family_slot(pg_family, MM_FALSE) : 0;
+	uint32_t bucket, c;
 
-	for (vm_page_for_families_curr = first_vm_page_for_families;
-		 vm_page_for_families_curr;
-		 vm_page_for_families_curr = vm_page_for_families_curr->next)
+	memset(sum, 0, sizeof(mm_latency_histogram_t));
+
+	for (thread_lat = __atomic_load_n(&mm_lat_threads, __ATOMIC_ACQUIRE);
+		 thread_lat; thread_lat = thread_lat->next)
 	{
-		ITERATE_PAGE_FAMILIES_BEGIN(vm_page_for_families_curr, vm_page_family_curr)
+		for (bucket = 0; bucket < MM_LAT_BUCKETS; bucket++)
 		{
-
-			if (strncmp(vm_page_family_curr->struct_name,
-						struct_name,
-						MM_MAX_STRUCT_NAME) == 0)
+			if (pg_family)
 			{
+				sum->count[bucket] += __atomic_load_n(
+					&thread_lat->by_family[stats_index - 1][op].count[bucket],
+					__ATOMIC_RELAXED);
+				continue;
+			}
 
-				return vm_page_family_curr;
+			for (c = 0; c < MM_LAT_CAUSES; c++)
+			{
+				if (cause != MM_LAT_ANY_CAUSE && cause != c)
+					continue;
+				sum->count[bucket] += __atomic_load_n(
+					&thread_lat->by_cause[op][c].count[bucket], __ATOMIC_RELAXED);
 			}
 		}
-		ITERATE_PAGE_FAMILIES_END(vm_page_for_families_curr, vm_page_family_curr);
 	}
-	return NULL;
 }
 
-void *xcalloc(char *struct_name, int units)
+static uint64_t mm_lat_histogram_percentile(mm_latency_histogram_t *histogram,
+											double percentile)
 {
-	/*step 1*/
-	vm_page_family_t *pg_family =
-		lookup_page_family_by_name(struct_name);
+	uint64_t total = 0, seen = 0;
+	uint32_t bucket;
 
-	if (!pg_family)
-	{
-		printf("Error : Structure %s is not registered with mmory manager\n", struct_name);
-		return NULL;
-	}
+	for (bucket = 0; bucket < MM_LAT_BUCKETS; bucket++)
+		total += histogram->count[bucket];
+
+	if (!total)
+		return 0;
 
-	if ((units * pg_family->struct_size) > MAX_PAGE_ALLOCATABLE_MEMORY(1))
+	uint64_t rank = (uint64_t)(total * percentile / 100.0);
+	if (rank >= total)
+		rank = total - 1;
+
+	for (bucket = 0; bucket < MM_LAT_BUCKETS; bucket++)
 	{
-		printf("Error : Memory Requested exceeds page size\n");
-		return NULL;
+		seen += histogram->count[bucket];
+		if (seen > rank)
+			break;
 	}
+	return (uint64_t)(mm_lat_bucket_limit(bucket) * mm_lat_ns_per_tick);
+}
 
-	/*Find the page which can satisfy the request*/
-	block_meta_data_t *free_block_meta_data = NULL;
-
-	free_block_meta_data = mm_allocate_free_data_block(
-		pg_family, units * pg_family->struct_size);
+uint64_t mm_latency_percentile(char *struct_name, mm_lat_op_t op,
+							   mm_lat_cause_t cause, double percentile)
+{
+	mm_latency_histogram_t sum;
+	vm_page_family_t *pg_family = NULL;
 
-	if (free_block_meta_data)
+	if (struct_name)
 	{
-		memset((char *)(free_block_meta_data + 1), 0,
-			   free_block_meta_data->block_size);
-		return (void *)(free_block_meta_data + 1);
+		mm_lock();
+		pg_family = lookup_page_family_by_name(struct_name);
+		mm_unlock();
+
+		if (!pg_family || !mm_lat_family_slot(pg_family, MM_FALSE))
+			return 0;
 	}
 
-	return NULL;
+	mm_lat_collect(&sum, pg_family, op, cause);
+	return mm_lat_histogram_percentile(&sum, percentile);
 }
 
-void xfree(void *app_ptr)
+static uint64_t mm_lat_histogram_total(mm_latency_histogram_t *histogram)
 {
-	block_meta_data_t *block_meta_data =
-		(block_meta_data_t *)((char *)app_ptr - sizeof(block_meta_data_t));
+	uint64_t total = 0;
+	uint32_t bucket;
 
-	assert(block_meta_data->is_free == MM_FALSE);
+	for (bucket = 0; bucket < MM_LAT_BUCKETS; bucket++)
+		total += histogram->count[bucket];
+	return total;
+}
+
+void mm_print_latency_stats()
+{
+	static const char *op_names[MM_LAT_OPS] = {"xcalloc", "xfree"};
+	static const char *cause_names[MM_LAT_CAUSES + 1] = {
+		"fast path", "new page", "page free", "long walk", "all"};
+	mm_latency_histogram_t sum;
+	vm_page_family_t *vm_page_family_curr = NULL;
+	uint32_t op, cause;
+
+	for (op = 0; op < MM_LAT_OPS; op++)
+	{
+		for (cause = 0; cause <= MM_LAT_CAUSES; cause++)
+		{
+			mm_lat_collect(&sum, NULL, op, cause);
+			printf("%-8s %-10s count : %-10lu p50 : %-8lu p99 : %-8lu p99.9 : %-8lu ns\n",
+				   op_names[op], cause_names[cause], mm_lat_histogram_total(&sum),
+				   mm_lat_histogram_percentile(&sum, 50),
+				   mm_lat_histogram_percentile(&sum, 99),
+				   mm_lat_histogram_percentile(&sum, 99.9));
+		}
+	}
+
+	mm_lock();
+	if (first_vm_page_for_families)
+	{
+		ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
+		{
+			if (!mm_lat_family_slot(vm_page_family_curr, MM_FALSE))
+				continue;
 
-	mm_free_blocks(block_meta_data);
+			for (op = 0; op < MM_LAT_OPS; op++)
+			{
+				mm_lat_collect(&sum, vm_page_family_curr, op, MM_LAT_ANY_CAUSE);
+				printf("%-20s %-8s count : %-10lu p50 : %-8lu p99 : %-8lu ns\n",
+					   vm_page_family_curr->struct_name, op_names[op],
+					   mm_lat_histogram_total(&sum),
+					   mm_lat_histogram_percentile(&sum, 50),
+					   mm_lat_histogram_percentile(&sum, 99));
+			}
+		}
+		ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_family_curr);
+	}
+	mm_unlock();
 }
 
 void mm_print_registered_page_families()
@@ -496,6 +3947,7 @@ void mm_print_registered_page_families()
 	vm_page_family_t *vm_page_family_curr = NULL;
 	vm_page_for_families_t *vm_page_for_families_curr = NULL;
 
+	mm_lock();
 	for (vm_page_for_families_curr = first_vm_page_for_families;
 		 vm_page_for_families_curr;
 		 vm_page_for_families_curr = vm_page_for_families_curr->next)
@@ -510,6 +3962,7 @@ void mm_print_registered_page_families()
 		}
 		ITERATE_PAGE_FAMILIES_END(vm_page_for_families_curr, vm_page_family_curr);
 	}
+	mm_unlock();
 }
 
 void mm_print_vm_page_details(vm_page_t *vm_page)
@@ -526,7 +3979,8 @@ void mm_print_vm_page_details(vm_page_t *vm_page)
 		printf("\t\t\t%-14p Block %-3u %s block_size = %-6u "
 			   "offset = %-6u prev = %-14p next = %p\n",
 			   curr,
-			   j++, curr->is_free ? "F R E E D" : "ALLOCATED",
+			   j++, curr->is_free ? "F R E E D" : curr->is_deferred ? "DEFERRED " :
+				   (vm_page->color && curr == &vm_page->block_meta_data) ? "COLOR PAD" : "ALLOCATED",
 			   curr->block_size, curr->offset,
 			   curr->prev_block,
 			   curr->next_block);
@@ -544,6 +3998,13 @@ void mm_print_memory_usage(char *struct_name)
 
 	printf("\nPage Size = %zu Bytes\n", SYSTEM_PAGE_SIZE);
 
+	mm_lock();
+	if (!first_vm_page_for_families)
+	{
+		mm_unlock();
+		return;
+	}
+
 	ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
 	{
 
@@ -558,21 +4019,23 @@ void mm_print_memory_usage(char *struct_name)
 
 		number_of_struct_families++;
 
-		printf(ANSI_COLOR_GREEN "vm_page_family : %s, struct size = %u\n" ANSI_COLOR_RESET,
+		printf(ANSI_COLOR_GREEN "vm_page_family : %s, struct size = %u, span = %u pages\n" ANSI_COLOR_RESET,
 			   vm_page_family_curr->struct_name,
-			   vm_page_family_curr->struct_size);
+			   vm_page_family_curr->struct_size,
+			   vm_page_family_curr->span_pages);
 
 		i = 0;
 
 		ITERATE_VM_PAGE_BEGIN(vm_page_family_curr, vm_page)
 		{
-			cumulative_vm_pages_claimed_from_kernel++;
+			cumulative_vm_pages_claimed_from_kernel += vm_page_family_curr->span_pages;
 			mm_print_vm_page_details(vm_page);
 		}
 		ITERATE_VM_PAGE_END(vm_page_family_curr, vm_page);
 		printf("\n");
 	}
 	ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_family_curr);
+	mm_unlock();
 
 	printf(ANSI_COLOR_MAGENTA "# of VM Pages in Use : %u (%lu Bytes)\n" ANSI_COLOR_RESET,
 		   cumulative_vm_pages_claimed_from_kernel,
@@ -592,6 +4055,13 @@ void mm_print_block_usage()
 	uint32_t total_block_count, free_block_count, occupied_block_count;
 	uint32_t application_memory_usage;
 
+	mm_lock();
+	if (!first_vm_page_for_families)
+	{
+		mm_unlock();
+		return;
+	}
+
 	ITERATE_PAGE_FAMILIES_BEGIN(first_vm_page_for_families, vm_page_family_curr)
 	{
 
@@ -604,14 +4074,14 @@ void mm_print_block_usage()
 
 			ITERATE_VM_PAGE_ALL_BLOCKS_BEGIN(vm_page_curr, block_meta_data_curr)
 			{
+				if (vm_page_curr->color &&
+					block_meta_data_curr == &vm_page_curr->block_meta_data)
+					continue;
 
 				total_block_count++;
 
-				/*Sanity Checks*/
-				if (block_meta_data_curr->is_free == MM_FALSE)
-				{
-					assert(IS_GLTHREAD_LIST_EMPTY(&block_meta_data_curr->priority_thread_glue));
-				}
+				/*Sanity Checks, allocated blocks may be queued on an
+					epoch limbo list by xfree_deferred*/
 				if (block_meta_data_curr->is_free == MM_TRUE)
 				{
 					assert(!IS_GLTHREAD_LIST_EMPTY(&block_meta_data_curr->priority_thread_glue));
@@ -638,4 +4108,5 @@ void mm_print_block_usage()
 			   free_block_count, occupied_block_count, application_memory_usage);
 	}
 	ITERATE_PAGE_FAMILIES_END(first_vm_page_for_families, vm_page_family_curr);
+	mm_unlock();
 }
@@ -3,7 +3,9 @@
 
 #include <stddef.h> /*for size_t*/
 #include <stdint.h> /*uint32_t*/
+#include <pthread.h>
 #include "gluethread/glthread.h"
+#include "uapi_mm.h"
 
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
@@ -24,6 +26,7 @@ typedef struct block_meta_data_
 	vm_bool_t is_free;
 	uint32_t block_size;
 	uint32_t offset; // offset from the start of the page
+	vm_bool_t is_deferred; /*freed, parked on the family deferred free list*/
 	glthread_t priority_thread_glue;
 	struct block_meta_data_ *prev_block;
 	struct block_meta_data_ *next_block;
@@ -43,11 +46,46 @@ typedef struct vm_page_
 	struct vm_page_ *next;
 	struct vm_page_ *prev;
 	struct vm_page_family_ *pg_family; /*back pointer*/
+	uint32_t color; /*data starts color bytes later, the first block is then a pad*/
+	uint32_t page_index; /*slot in the family page directory*/
+	vm_bool_t purged; /*free system pages of the span given back, until the next free*/
 	block_meta_data_t block_meta_data;
 	char page_memory[0]; /*first data block in VM page*/
 } vm_page_t;
 
+/*Page directory of a family : maps the page index of a 32 bit object
+	handle to its VM page. It is grown by doubling, replaced directories
+	are kept until the family releases its pages so that handles being
+	resolved without the lock never read freed memory. Relocatable
+	families keep a second one, the object directory, mapping the handles
+	of their objects to the objects*/
+typedef struct mm_page_directory_
+{
+	struct mm_page_directory_ *retired; /*directories it replaced*/
+	uint32_t units;						/*VM pages it occupies*/
+	uint32_t capacity;
+	uint32_t used;		 /*entries handed out so far*/
+	uint32_t free_index; /*first free entry + 1, 0 : none*/
+	uintptr_t entries[0]; /*vm_page_t * or object, or next free entry + 1 << 1 | 1*/
+} mm_page_directory_t;
+
+#define MM_PAGE_DIRECTORY_FREE_ENTRY(next_free_index) \
+	(((uintptr_t)(next_free_index) << 1) | 1)
+
 #define MM_MAX_STRUCT_NAME 32
+
+/*VM data pages of a family span 1..MM_MAX_SPAN_PAGES system pages,
+	the smallest span costing at most 1/MM_SPAN_WASTE_TOLERANCE more
+	memory per object than the best one is used*/
+#define MM_MAX_SPAN_PAGES 16
+#define MM_SPAN_WASTE_TOLERANCE 8
+
+/*Adaptive strategy : a family looks at its traffic every MM_ADAPT_WINDOW
+	allocations. Under MM_STRATEGY_SLOTS it parks up to
+	MM_ADAPT_SLOTS_MAX_DEFERRED single object blocks*/
+#define MM_ADAPT_WINDOW 256
+#define MM_ADAPT_SLOTS_MAX_DEFERRED 1024
+
 typedef struct vm_page_family_
 {
 
@@ -55,8 +93,59 @@ typedef struct vm_page_family_
 	uint32_t struct_size;
 	vm_page_t *first_page;
 	glthread_t free_block_priority_list_head;
+	uint32_t page_count;  /*system pages held by the family*/
+	uint32_t max_pages;	  /*family budget, 0 : unlimited*/
+	/*Deferred coalescing : recently freed single objects, reused as is
+		and merged with their neighbours in batches*/
+	glthread_t deferred_free_list_head;
+	uint32_t deferred_count;
+	uint32_t max_deferred; /*0 : frees are merged right away*/
+	uint32_t next_color;   /*color of the next page added*/
+	mm_page_directory_t *page_directory;
+	uint32_t span_pages;		 /*system pages per VM data page of the family*/
+	uint32_t handle_offset_bits; /*low bits of a handle : offset in the span*/
+	/*Adaptive strategy, applies to the pages added from now on*/
+	uint32_t strategy; /*mm_strategy_t*/
+	uint32_t window_allocs;
+	uint32_t window_single_allocs; /*of one unit*/
+	uint32_t window_frees;
+	uint32_t window_bulk_frees; /*mm_family_free_all() calls*/
+	/*Lazy splitting : the newest page hands out its untouched tail by
+		moving bump_ptr, the tail becomes a free block once the page is
+		retired, when the next page is added*/
+	vm_page_t *bump_page;
+	block_meta_data_t *bump_last; /*last block of bump_page, NULL : none*/
+	char *bump_ptr;
+	struct mm_cpu_cache_ *cpu_caches; /*one per CPU, NULL : not created*/
+	uint32_t relocatable;					/*objects reached by handle only*/
+	mm_page_directory_t *object_directory; /*relocatable : handle - 1 to object*/
 } vm_page_family_t;
 
+/*Relocatable families : every object is preceded by the handle the
+	application holds, so that compaction can move the object and update
+	its object directory entry. struct_size of the family includes it*/
+typedef struct mm_relocatable_header_
+{
+	uint32_t handle;
+	uint32_t tag; /*MM_RELOCATABLE_TAG, keeps objects pointer aligned*/
+} mm_relocatable_header_t;
+
+/*The tag lies where the object of a non relocatable family has the high
+	half of next_block, that no user space pointer has : XFREE and
+	xfree_deferred tell a relocatable object from it*/
+#define MM_RELOCATABLE_TAG 0xa110c8edu
+
+#define MM_RELOCATABLE_MAX_OBJECTS (1u << 31)
+
+/*Scratch of mm_compact_family() : a VM page of the family, its live
+	objects and how many more its free blocks can take*/
+typedef struct mm_compact_page_
+{
+	vm_page_t *vm_page;
+	uint32_t live;
+	uint32_t free_slots;
+} mm_compact_page_t;
+
 typedef struct vm_page_for_families_
 {
 
@@ -64,6 +153,150 @@ typedef struct vm_page_for_families_
 	vm_page_family_t vm_page_family[0];
 } vm_page_for_families_t;
 
+/*Arena (region) allocation : objects are carved out of the arena's
+	own pages by bumping a pointer, and the whole arena is returned
+	to the kernel at once, no per block meta data is maintained*/
+typedef struct mm_arena_page_
+{
+	struct mm_arena_page_ *next;
+	char page_memory[0];
+} mm_arena_page_t;
+
+typedef struct mm_arena_
+{
+	mm_arena_page_t *first_page; /*most recently added page first*/
+	char *free_ptr;				 /*next free byte in first_page*/
+	char *end_ptr;				 /*end of first_page*/
+	uint32_t page_count;
+} mm_arena_t;
+
+#define MM_ARENA_ALIGNMENT sizeof(void *)
+
+#define MM_ARENA_ALIGN(size) \
+	(((size) + MM_ARENA_ALIGNMENT - 1) & ~(MM_ARENA_ALIGNMENT - 1))
+
+/*Shared heap mode : all VM pages, including the VM pages for families,
+	are carved out of one shm segment. Every process maps the segment
+	at the base address recorded by its creator, so block, page and
+	family pointers stored inside the heap are valid in all of them*/
+typedef struct mm_free_page_run_
+{
+	struct mm_free_page_run_ *next;
+	uint32_t units;
+} mm_free_page_run_t;
+
+#define MM_SHARED_HEAP_MAGIC 0x4d4d5348 /*"MMSH"*/
+
+/*Persistent heap mode : the same layout in a MAP_SHARED file, reopened
+	by later runs of the process. The file is mapped at its recorded
+	base address when possible, else every pointer kept by the memory
+	manager is relocated. Objects refer to each other by heap offsets*/
+#define MM_PERSISTENT_HEAP_MAGIC 0x4d4d5048 /*"MMPH"*/
+
+typedef struct mm_shared_heap_
+{
+	uint32_t magic;
+	uint32_t page_size;
+	void *base_address;
+	size_t heap_size;
+	char *next_unused_page;			   /*pages above it were never handed out*/
+	mm_free_page_run_t *free_page_runs; /*pages returned to the segment*/
+	vm_page_for_families_t *first_vm_page_for_families;
+	uint32_t family_generation;
+	pthread_mutex_t mutex; /*process shared, robust*/
+	vm_bool_t clean_shutdown; /*persistent heap closed by mm_close_persistent*/
+	size_t root_offset;		  /*persistent heap root object, 0 : none*/
+} mm_shared_heap_t;
+
+/*Memory budget : pages held by the memory manager are accounted
+	here. Empty VM data pages are retained for reuse while usage stays
+	below the soft limit, the scavenger gives retained pages back once
+	usage goes above it. A new page past the hard limit fails the
+	allocation once the pressure callback had a chance to free memory*/
+typedef struct mm_budget_
+{
+	size_t soft_limit_pages; /*0 : empty pages are not retained*/
+	size_t hard_limit_pages; /*0 : unlimited*/
+	size_t pages_in_use;
+	size_t pages_retained;
+	vm_page_t *retained_pages; /*linked through vm_page_t next*/
+	void (*pressure_cb)(char *struct_name, size_t requested_bytes);
+} mm_budget_t;
+
+/*Latency histograms : log-linear, 4 linear sub buckets per power of
+	two of the operation duration in TSC ticks. Every thread records in
+	its own histograms, readers sum them over all threads*/
+#define MM_LAT_SUB_BUCKET_BITS 2
+#define MM_LAT_SUB_BUCKETS (1 << MM_LAT_SUB_BUCKET_BITS)
+#define MM_LAT_BUCKETS (MM_LAT_SUB_BUCKETS * 40)
+#define MM_LAT_MAX_FAMILIES 32		  /*families past it share the last slot*/
+#define MM_LAT_LONG_WALK_COMPARED 32 /*free list elements compared*/
+
+typedef struct mm_latency_histogram_
+{
+	uint64_t count[MM_LAT_BUCKETS];
+} mm_latency_histogram_t;
+
+typedef struct mm_thread_latency_
+{
+	struct mm_thread_latency_ *next;
+	uint32_t in_use; /*0 : owner thread exited, the next thread takes it over*/
+	mm_latency_histogram_t by_cause[MM_LAT_OPS][MM_LAT_CAUSES];
+	mm_latency_histogram_t by_family[MM_LAT_MAX_FAMILIES + 1][MM_LAT_OPS];
+} mm_thread_latency_t;
+
+/*Epoch based reclamation : readers announce the global epoch they
+	entered in, objects retired by xfree_deferred wait on one of three
+	limbo lists, linked through their block meta data, until the epoch
+	has advanced twice past the one they were retired in*/
+#define MM_EPOCH_LIMBO_LISTS 3
+#define MM_EPOCH_RECLAIM_BATCH 64 /*retirements between advance attempts*/
+
+typedef struct mm_epoch_thread_
+{
+	struct mm_epoch_thread_ *next;
+	uint64_t state; /*entered epoch << 1 | 1 while inside, 0 outside*/
+	uint32_t nesting;
+} mm_epoch_thread_t;
+
+/*Static probes (USDT) of provider mm, for bpftrace or perf on a live
+	process. With <sys/sdt.h> a probe is a nop instruction and an ELF
+	note naming where its arguments live, nothing runs unless a tracer
+	attaches. Without it, or with MM_NO_PROBES, probes compile away*/
+#if defined(__has_include) && !defined(MM_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MM_PROBES_ENABLED
+#endif
+#endif
+
+#ifdef MM_PROBES_ENABLED
+#define MM_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(mm, name, a1, a2, a3)
+#define MM_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(mm, name, a1, a2, a3, a4)
+#else
+#define MM_PROBE3(name, a1, a2, a3) do {} while (0)
+#define MM_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+
+/*Cache coloring : consecutive pages of a family start their data one
+	cache line apart, within the slack a page full of objects leaves*/
+#define MM_CACHE_LINE_SIZE 64
+
+/*Per-CPU caches of single object blocks of a family, changed only in
+	restartable sequences by threads running on that CPU. A locked path
+	sets stopped and waits out the sequences in flight before touching
+	a cache of another CPU. Cached blocks look allocated to the rest of
+	the memory manager*/
+#define MM_CPU_CACHE_SLOTS 30
+#define MM_CPU_CACHE_BATCH 15 /*blocks moved from or to a cache at once*/
+
+typedef struct mm_cpu_cache_
+{
+	uint64_t stopped;
+	uint64_t count;
+	block_meta_data_t *blocks[MM_CPU_CACHE_SLOTS];
+} __attribute__((aligned(MM_CACHE_LINE_SIZE))) mm_cpu_cache_t;
+
 #define MAX_FAMILIES_PER_VM_PAGE \
 	((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_families_t *)) / sizeof(vm_page_family_t))
 
@@ -80,12 +313,22 @@ static inline block_meta_data_t *mm_get_biggest_free_block_page_family(
 	return NULL;
 }
 
+/*First block holding application data, past the coloring pad*/
+static inline block_meta_data_t *mm_vm_page_first_data_block(vm_page_t *vm_page)
+{
+	if (vm_page->color)
+		return vm_page->block_meta_data.next_block;
+	return &vm_page->block_meta_data;
+}
+
 vm_bool_t mm_is_vm_page_empty(vm_page_t *vm_page);
 
 vm_page_t *allocate_vm_page(vm_page_family_t *vm_page_family);
 
 void mm_vm_page_delete_and_free(vm_page_t *vm_page);
 
+vm_page_family_t *lookup_page_family_by_name(char *struct_name);
+
 static void mm_union_free_blocks(block_meta_data_t *first,
 								 block_meta_data_t *second);
 
@@ -1,5 +1,11 @@
 #include "uapi_mm.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 typedef struct emp_ {
 	
@@ -17,12 +23,958 @@ typedef struct student_ {
 	struct student_ *next;
 } student_t;
 
+static int failures;
+
+#define TEST_CHECK(cond)	\
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAILED %s() : %s\n", __FUNCTION__, #cond); \
+		} \
+	} while (0)
+
+typedef struct node_ {
+
+	uint32_t id;
+	struct node_ *next;
+} node_t;
+
+/*Objects of an arena are zero filled, spread over several pages, and
+	released together*/
+static void test_arena(){
+
+	int i;
+	node_t *head = NULL, *node = NULL;
+	mm_arena_t *arena = mm_arena_create();
+
+	TEST_CHECK(arena != NULL);
+
+	for (i = 0; i < 1000; i++){
+		node = XCALLOC_IN(arena, 1, node_t);
+		TEST_CHECK(node && node->id == 0 && node->next == NULL);
+		node->id = i;
+		node->next = head;
+		head = node;
+	}
+
+	for (i = 999, node = head; node; node = node->next, i--)
+		TEST_CHECK(node->id == (uint32_t)i);
+	TEST_CHECK(i == -1);
+
+	mm_arena_destroy(arena);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct scratch_ {
+
+	char data[200];
+} scratch_t;
+
+/*Bulk release keeps the family registered, unregistration removes it*/
+static void test_family_free_all(){
+
+	int i;
+	scratch_t *scratch = NULL;
+
+	MM_REG_STRUCT(scratch_t);
+	for (i = 0; i < 500; i++){
+		scratch = XCALLOC(1, scratch_t);
+		TEST_CHECK(scratch != NULL);
+		memset(scratch, 0xff, sizeof(scratch_t));
+	}
+
+	MM_FAMILY_FREE_ALL(scratch_t);
+	scratch = XCALLOC(1, scratch_t);
+	TEST_CHECK(scratch && scratch->data[0] == 0 && scratch->data[199] == 0);
+
+	MM_UNREG_STRUCT(scratch_t);
+	TEST_CHECK(XCALLOC(1, scratch_t) == NULL);
+
+	MM_REG_STRUCT(scratch_t);
+	scratch = XCALLOC(1, scratch_t);
+	TEST_CHECK(scratch != NULL);
+	MM_UNREG_STRUCT(scratch_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*Heap modes replace mm_init(), so their tests run in a child process
+	forked before the memory manager is initialized*/
+static void test_in_child(void (*test_fn)()){
+
+	int status = 0;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0){
+		test_fn();
+		exit(failures);
+	}
+
+	if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+		!WIFEXITED(status) || WEXITSTATUS(status))
+		failures++;
+}
+
+#define TEST_SHM_NAME	"/testapp_mm_heap"
+
+static void test_shared_heap_writer(){
+
+	int i;
+	node_t *head = NULL, *node = NULL;
+
+	TEST_CHECK(mm_init_shared(TEST_SHM_NAME, 64 * 4096) == 0);
+	MM_REG_STRUCT(node_t);
+	mm_latency_stats_enable(1);
+
+	for (i = 0; i < 100; i++){
+		node = XCALLOC(1, node_t);
+		TEST_CHECK(node != NULL);
+		node->id = i;
+		node->next = head;
+		head = node;
+	}
+	mm_set_heap_root(head);
+}
+
+/*A second process attaches and finds the list by the heap root. Its
+	latency histograms are its own, per family too*/
+static void test_shared_heap_reader(){
+
+	int i = 99;
+	node_t *node = NULL, *next = NULL;
+	emp_t *emp = NULL;
+
+	TEST_CHECK(mm_init_shared(TEST_SHM_NAME, 64 * 4096) == 0);
+	MM_REG_STRUCT(emp_t);
+	mm_latency_stats_enable(1);
+
+	for (node = mm_heap_root(); node; node = next, i--){
+		TEST_CHECK(node->id == (uint32_t)i);
+		next = node->next;
+		XFREE(node);
+	}
+	TEST_CHECK(i == -1);
+	mm_set_heap_root(NULL);
+
+	emp = XCALLOC(1, emp_t);
+	TEST_CHECK(mm_latency_percentile("node_t", MM_LAT_XFREE, MM_LAT_ANY_CAUSE, 50) > 0);
+	TEST_CHECK(mm_latency_percentile("node_t", MM_LAT_XCALLOC, MM_LAT_ANY_CAUSE, 50) == 0);
+	TEST_CHECK(mm_latency_percentile("emp_t", MM_LAT_XFREE, MM_LAT_ANY_CAUSE, 50) == 0);
+	TEST_CHECK(mm_latency_percentile("emp_t", MM_LAT_XCALLOC, MM_LAT_ANY_CAUSE, 50) > 0);
+	XFREE(emp);
+	printf("test_shared_heap() done\n");
+}
+
+static void test_shared_heap(){
+
+	shm_unlink(TEST_SHM_NAME);
+	test_in_child(test_shared_heap_writer);
+	test_in_child(test_shared_heap_reader);
+	shm_unlink(TEST_SHM_NAME);
+}
+
+typedef struct bound_ {
+
+	uint64_t key;
+	uint64_t value;
+} bound_t;
+
+static void *test_family_bind_fn(void *arg){
+
+	return mm_page_family_bind("bound_t", sizeof(bound_t));
+}
+
+/*Threads binding a new name at once all get the one family it is
+	registered under, a size mismatch is refused*/
+static void test_family_bind(){
+
+	int i;
+	pthread_t threads[4];
+	void *pg_family[4];
+	bound_t *bound = NULL;
+
+	mm_thread_safe_enable();
+	for (i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, test_family_bind_fn, NULL);
+	for (i = 0; i < 4; i++)
+		pthread_join(threads[i], &pg_family[i]);
+
+	for (i = 0; i < 4; i++)
+		TEST_CHECK(pg_family[i] && pg_family[i] == pg_family[0]);
+
+	TEST_CHECK(mm_max_allocation_size(pg_family[0]) >= 4 * sizeof(bound_t));
+	bound = xcalloc_family(pg_family[0], 4);
+	TEST_CHECK(bound && bound[3].key == 0);
+	XFREE(bound);
+
+	TEST_CHECK(mm_page_family_bind("bound_t", sizeof(bound_t) + 8) == NULL);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct budget_ {
+
+	char data[256];
+} budget_t;
+
+static int pressure_calls;
+
+static void test_budget_pressure_cb(char *struct_name, size_t requested_bytes){
+
+	pressure_calls++;
+}
+
+/*A family past its budget fails once the pressure callback declined to
+	help, empty pages kept below the soft limit are scavenged above it*/
+static void test_budget(){
+
+	int i, count;
+	budget_t *budget[200];
+	size_t resident;
+
+	MM_REG_STRUCT(budget_t);
+	MM_SET_FAMILY_BUDGET(budget_t, 4 * 4096);
+	mm_set_pressure_callback(test_budget_pressure_cb);
+
+	for (count = 0; count < 200; count++){
+		budget[count] = XCALLOC(1, budget_t);
+		if (!budget[count])
+			break;
+	}
+	TEST_CHECK(count > 0 && count < 200);
+	TEST_CHECK(count * sizeof(budget_t) <= 4 * 4096);
+	TEST_CHECK(pressure_calls == 1);
+
+	mm_set_memory_budget((size_t)1 << 30, 0);
+	for (i = 0; i < count; i++)
+		XFREE(budget[i]);
+	resident = mm_resident_bytes();
+
+	mm_set_memory_budget(0, 0);
+	TEST_CHECK(mm_scavenge(100) > 0);
+	TEST_CHECK(mm_resident_bytes() < resident);
+
+	mm_set_pressure_callback(NULL);
+	MM_UNREG_STRUCT(budget_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct spanned_ {
+
+	char data[3000];
+} spanned_t;
+
+/*Free system pages inside VM data pages spanning several are given back
+	by the scavenger once, objects around them keep their content*/
+static void test_scavenge_span_pages(){
+
+	int i;
+	spanned_t *spanned[64];
+
+	MM_REG_STRUCT(spanned_t);
+	for (i = 0; i < 64; i++){
+		spanned[i] = XCALLOC(1, spanned_t);
+		memset(spanned[i], i + 1, sizeof(spanned_t));
+	}
+	for (i = 0; i < 64; i++)
+		if (i % 8)
+			XFREE(spanned[i]);
+
+	mm_set_memory_budget(0, 0);
+	TEST_CHECK(mm_scavenge(1000) > 0);
+	TEST_CHECK(mm_scavenge(1000) == 0);
+
+	for (i = 0; i < 64; i++){
+		if (i % 8 == 0)
+			continue;
+		spanned[i] = XCALLOC(1, spanned_t);
+		TEST_CHECK(spanned[i] && spanned[i]->data[0] == 0 && spanned[i]->data[2999] == 0);
+	}
+	for (i = 0; i < 64; i++){
+		TEST_CHECK(i % 8 || (spanned[i]->data[0] == i + 1 && spanned[i]->data[2999] == i + 1));
+		XFREE(spanned[i]);
+	}
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	MM_UNREG_STRUCT(spanned_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+static void *test_latency_fn(void *arg){
+
+	int i;
+	for (i = 0; i < 100; i++)
+		XFREE(XCALLOC(1, emp_t));
+	return NULL;
+}
+
+/*Threads record latencies and exit, their counts stay in the totals*/
+static void test_latency(){
+
+	int i;
+	pthread_t thread;
+
+	mm_latency_stats_enable(1);
+	mm_latency_stats_reset();
+	for (i = 0; i < 20; i++){
+		pthread_create(&thread, NULL, test_latency_fn, NULL);
+		pthread_join(thread, NULL);
+	}
+
+	TEST_CHECK(mm_latency_percentile("emp_t", MM_LAT_XCALLOC, MM_LAT_ANY_CAUSE, 50) > 0);
+	TEST_CHECK(mm_latency_percentile(NULL, MM_LAT_XFREE, MM_LAT_ANY_CAUSE, 99) > 0);
+	mm_print_latency_stats();
+	mm_latency_stats_enable(0);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct parked_ {
+
+	uint64_t data[6];
+} parked_t;
+
+/*Freed objects are parked and handed out again as is, zero filled*/
+static void test_deferred_free(){
+
+	int i;
+	parked_t *parked[16];
+	parked_t *reused = NULL;
+
+	MM_REG_STRUCT(parked_t);
+	MM_SET_DEFERRED_FREE(parked_t, 8);
+
+	for (i = 0; i < 16; i++){
+		parked[i] = XCALLOC(1, parked_t);
+		memset(parked[i], 0xff, sizeof(parked_t));
+	}
+
+	XFREE(parked[5]);
+	reused = XCALLOC(1, parked_t);
+	TEST_CHECK(reused == parked[5]);
+	TEST_CHECK(reused->data[0] == 0 && reused->data[5] == 0);
+
+	for (i = 0; i < 16; i++)
+		XFREE(parked[i]);
+	mm_flush_deferred_frees();
+
+	MM_SET_DEFERRED_FREE(parked_t, 0);
+	MM_UNREG_STRUCT(parked_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*Allocation by size, from size class families or, above a page, from
+	pages of its own*/
+static void test_xmalloc(){
+
+	int i;
+	size_t sizes[] = {1, 24, 100, 1000, 3000, 10000};
+	char *ptr[6];
+
+	for (i = 0; i < 6; i++){
+		ptr[i] = xmalloc(sizes[i]);
+		TEST_CHECK(ptr[i] != NULL);
+		TEST_CHECK(((uintptr_t)ptr[i] % sizeof(void *)) == 0);
+		TEST_CHECK(ptr[i][0] == 0 && ptr[i][sizes[i] - 1] == 0);
+		memset(ptr[i], 0xff, sizes[i]);
+	}
+
+	for (i = 0; i < 6; i++)
+		XFREE(ptr[i]);
+
+	ptr[0] = xmalloc(100);
+	TEST_CHECK(ptr[0] && ptr[0][0] == 0 && ptr[0][99] == 0);
+	XFREE(ptr[0]);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+#define TEST_HEAP_FILE	"/tmp/testapp_mm_heap.bin"
+
+/*The heap may come back at another address, objects refer to each
+	other by heap offsets*/
+typedef struct pnode_ {
+
+	uint32_t id;
+	size_t next_offset;
+} pnode_t;
+
+static void test_persistent_heap_writer(){
+
+	int i;
+	pnode_t *node = NULL;
+	size_t head_offset = 0;
+
+	TEST_CHECK(mm_init_persistent(TEST_HEAP_FILE, 64 * 4096) == 0);
+	MM_REG_STRUCT(pnode_t);
+
+	for (i = 0; i < 100; i++){
+		node = XCALLOC(1, pnode_t);
+		TEST_CHECK(node != NULL);
+		node->id = i;
+		node->next_offset = head_offset;
+		head_offset = mm_heap_offset(node);
+	}
+	mm_set_heap_root(mm_heap_ptr(head_offset));
+	mm_close_persistent();
+}
+
+/*A later run reopens the heap and finds the list by the heap root*/
+static void test_persistent_heap_reader(){
+
+	int i = 99;
+	pnode_t *node = NULL;
+	size_t next_offset = 0;
+
+	TEST_CHECK(mm_init_persistent(TEST_HEAP_FILE, 64 * 4096) == 0);
+	MM_REG_STRUCT(pnode_t);
+
+	for (node = mm_heap_root(); node; node = mm_heap_ptr(next_offset), i--){
+		TEST_CHECK(node->id == (uint32_t)i);
+		next_offset = node->next_offset;
+		XFREE(node);
+	}
+	TEST_CHECK(i == -1);
+	mm_set_heap_root(NULL);
+
+	/*Refused, the object stays allocated*/
+	node = XCALLOC(1, pnode_t);
+	xfree_deferred(node);
+	TEST_CHECK(mm_epoch_reclaim() == 0);
+	XFREE(node);
+	mm_close_persistent();
+	printf("test_persistent_heap() done\n");
+}
+
+static void test_persistent_heap(){
+
+	unlink(TEST_HEAP_FILE);
+	test_in_child(test_persistent_heap_writer);
+	test_in_child(test_persistent_heap_reader);
+	unlink(TEST_HEAP_FILE);
+}
+
+static void *test_epoch_reader_fn(void *arg){
+
+	mm_epoch_enter();
+	TEST_CHECK(((node_t *)arg)->id == 7);
+	mm_epoch_exit();
+	return NULL;
+}
+
+/*Objects retired by xfree_deferred are freed only once no reader can
+	still see them, readers that exited do not hold reclamation back*/
+static void test_epoch(){
+
+	int i;
+	uint32_t reclaimed = 0;
+	pthread_t thread;
+	node_t *node[10];
+
+	for (i = 0; i < 10; i++){
+		node[i] = XCALLOC(1, node_t);
+		node[i]->id = 7;
+	}
+
+	for (i = 0; i < 10; i++){
+		pthread_create(&thread, NULL, test_epoch_reader_fn, node[i]);
+		pthread_join(thread, NULL);
+	}
+
+	mm_epoch_enter();
+	for (i = 0; i < 10; i++)
+		xfree_deferred(node[i]);
+	for (i = 0; i < 4; i++)
+		reclaimed += mm_epoch_reclaim();
+	TEST_CHECK(reclaimed == 0);
+	TEST_CHECK(node[9]->id == 7);
+	mm_epoch_exit();
+
+	for (i = 0; i < 4; i++)
+		reclaimed += mm_epoch_reclaim();
+	TEST_CHECK(reclaimed == 10);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct retired_ {
+
+	uint32_t data[8];
+} retired_t;
+
+/*Objects still waiting for reclamation go with the pages of their
+	family on a bulk release, relocatable objects are refused*/
+static void test_epoch_bulk_release(){
+
+	int i;
+	uint32_t reclaimed = 0, handle = 0;
+	void *pg_family = NULL;
+	node_t *node = XCALLOC(1, node_t);
+
+	MM_REG_STRUCT(retired_t);
+	mm_epoch_enter();
+	for (i = 0; i < 20; i++)
+		xfree_deferred(XCALLOC(1, retired_t));
+	xfree_deferred(node);
+	mm_epoch_exit();
+
+	MM_FAMILY_FREE_ALL(retired_t);
+	for (i = 0; i < 4; i++)
+		reclaimed += mm_epoch_reclaim();
+	TEST_CHECK(reclaimed == 1);
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	MM_UNREG_STRUCT(retired_t);
+
+	pg_family = mm_relocatable_family_bind("retired_t", sizeof(retired_t));
+	handle = xcalloc_handle(pg_family);
+	((retired_t *)mm_relocatable_ptr(pg_family, handle))->data[0] = 5;
+	xfree_deferred(mm_relocatable_ptr(pg_family, handle));
+	XFREE(mm_relocatable_ptr(pg_family, handle));
+	for (i = 0; i < 4; i++)
+		reclaimed += mm_epoch_reclaim();
+	TEST_CHECK(reclaimed == 1);
+	TEST_CHECK(((retired_t *)mm_relocatable_ptr(pg_family, handle))->data[0] == 5);
+	xfree_handle(pg_family, handle);
+	MM_UNREG_STRUCT(retired_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct colored_ {
+
+	char data[100];
+} colored_t;
+
+/*Pages of a family are colored, each starts its objects a cache line
+	further than the previous one. The largest request still fits on
+	every page*/
+static void test_cache_coloring(){
+
+	int i, units;
+	void *pg_family = NULL;
+	colored_t *colored[8];
+	uintptr_t color_mask = 0;
+
+	MM_REG_STRUCT(colored_t);
+	pg_family = mm_page_family_bind("colored_t", sizeof(colored_t));
+	units = mm_max_allocation_size(pg_family) / sizeof(colored_t);
+	TEST_CHECK(units > 1);
+
+	for (i = 0; i < 8; i++){
+		colored[i] = XCALLOC(units, colored_t);
+		TEST_CHECK(colored[i] != NULL);
+		if (colored[i])
+			color_mask |= (uintptr_t)colored[i] & 4095;
+	}
+	TEST_CHECK(color_mask & ~(uintptr_t)63);
+
+	for (i = 0; i < 8; i++)
+		if (colored[i])
+			XFREE(colored[i]);
+	MM_UNREG_STRUCT(colored_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*32 bit handles resolve back to their objects, 0 stands for NULL*/
+static void test_handles(){
+
+	int i;
+	void *pg_family = mm_page_family_bind("node_t", sizeof(node_t));
+	node_t *node[300];
+	uint32_t handle[300];
+
+	for (i = 0; i < 300; i++){
+		node[i] = XCALLOC(1, node_t);
+		handle[i] = mm_ptr_to_handle(node[i]);
+		TEST_CHECK(handle[i] != 0);
+	}
+
+	for (i = 0; i < 300; i++){
+		TEST_CHECK(mm_handle_to_ptr(pg_family, handle[i]) == node[i]);
+		TEST_CHECK(i == 0 || handle[i] != handle[i - 1]);
+	}
+
+	TEST_CHECK(mm_ptr_to_handle(NULL) == 0);
+	TEST_CHECK(mm_handle_to_ptr(pg_family, 0) == NULL);
+	TEST_CHECK(mm_handle_to_ptr(pg_family, 0xffffffff) == NULL);
+	TEST_CHECK(mm_handle_to_ptr(pg_family, handle[299] + (1u << 24)) == NULL);
+
+	for (i = 0; i < 300; i++)
+		XFREE(node[i]);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct wide_ {
+
+	char data[2100];
+} wide_t;
+
+/*A 2.1K structure gets VM data pages spanning 4 system pages holding
+	seven of them, so that a page does not waste half of itself*/
+static void test_span_pages(){
+
+	int i;
+	void *pg_family = NULL;
+	wide_t *wide[20];
+
+	MM_REG_STRUCT(wide_t);
+	pg_family = mm_page_family_bind("wide_t", sizeof(wide_t));
+	TEST_CHECK(mm_max_allocation_size(pg_family) >= 2 * sizeof(wide_t));
+	TEST_CHECK(mm_max_allocation_size(pg_family) > 3 * 4096);
+	TEST_CHECK(mm_max_allocation_size(pg_family) < 4 * 4096);
+
+	for (i = 0; i < 20; i++){
+		wide[i] = XCALLOC(1, wide_t);
+		TEST_CHECK(wide[i] && wide[i]->data[2099] == 0);
+		memset(wide[i], i, sizeof(wide_t));
+	}
+
+	for (i = 1; i < 7; i++)
+		TEST_CHECK((size_t)((char *)wide[i] - (char *)wide[0]) < 4 * 4096);
+
+	for (i = 0; i < 20; i++){
+		TEST_CHECK(wide[i]->data[0] == i && wide[i]->data[2099] == i);
+		XFREE(wide[i]);
+	}
+	MM_UNREG_STRUCT(wide_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct provider_stats_ {
+
+	size_t pages_out;
+	size_t pages_back;
+} provider_stats_t;
+
+static void *test_provider_get_pages(void *ctx, size_t size){
+
+	void *pages = mmap(NULL, size, PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (pages == MAP_FAILED)
+		return NULL;
+	((provider_stats_t *)ctx)->pages_out += size / 4096;
+	return pages;
+}
+
+static void test_provider_return_pages(void *ctx, void *pages, size_t size){
+
+	((provider_stats_t *)ctx)->pages_back += size / 4096;
+	munmap(pages, size);
+}
+
+/*Every page of the memory manager comes from, and goes back to, the
+	page provider*/
+static void test_page_provider(){
+
+	int i;
+	node_t *node[1000];
+	provider_stats_t stats = {0, 0};
+	mm_page_provider_t page_provider = {test_provider_get_pages,
+										test_provider_return_pages, &stats};
+
+	mm_init_provider(&page_provider);
+	MM_REG_STRUCT(node_t);
+
+	for (i = 0; i < 1000; i++)
+		node[i] = XCALLOC(1, node_t);
+	TEST_CHECK(stats.pages_out * 4096 > 1000 * sizeof(node_t));
+
+	for (i = 0; i < 1000; i++)
+		XFREE(node[i]);
+	MM_UNREG_STRUCT(node_t);
+	TEST_CHECK(stats.pages_back > 0 && stats.pages_back == stats.pages_out);
+	printf("test_page_provider() done\n");
+}
+
+static int verify_reports;
+
+static void test_verify_cb(char *struct_name, void *vm_page,
+						   void *block, char *problem){
+
+	verify_reports++;
+}
+
+/*The verifier finds nothing wrong in a sound heap, and notices an
+	object overrunning into the block after it*/
+static void test_verifier(){
+
+	int i;
+	char saved[64];
+	scratch_t *scratch[4];
+
+	MM_REG_STRUCT(scratch_t);
+	for (i = 0; i < 4; i++)
+		scratch[i] = XCALLOC(1, scratch_t);
+
+	mm_set_verify_callback(test_verify_cb);
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	TEST_CHECK(mm_verifier_start(1, 4) == 0);
+	usleep(20000);
+	mm_verifier_stop();
+	TEST_CHECK(verify_reports == 0);
+
+	/*Overrun scratch[1] into the block meta data of scratch[2]*/
+	memcpy(saved, (char *)scratch[2] - sizeof(saved), sizeof(saved));
+	memset((char *)scratch[2] - sizeof(saved), 0x5a, sizeof(saved));
+	TEST_CHECK(mm_verify_step(100000) > 0);
+	TEST_CHECK(verify_reports > 0);
+	memcpy((char *)scratch[2] - sizeof(saved), saved, sizeof(saved));
+
+	verify_reports = 0;
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	mm_set_verify_callback(NULL);
+
+	for (i = 0; i < 4; i++)
+		XFREE(scratch[i]);
+	MM_UNREG_STRUCT(scratch_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct slot_ {
+
+	uint64_t data[5];
+} slot_t;
+
+typedef struct bump_ {
+
+	uint64_t data[3];
+} bump_t;
+
+/*A family of single objects freed one by one switches to slots, one
+	released in bulk switches to bump allocation*/
+static void test_adaptive_strategy(){
+
+	int i, round;
+	slot_t *slot[64];
+	bump_t *bump = NULL;
+
+	MM_REG_STRUCT(slot_t);
+	MM_REG_STRUCT(bump_t);
+	mm_adaptive_strategy_enable(1);
+
+	for (round = 0; round < 32; round++){
+		for (i = 0; i < 64; i++)
+			slot[i] = XCALLOC(1, slot_t);
+		for (i = 0; i < 64; i++)
+			XFREE(slot[i]);
+	}
+
+	for (round = 0; round < 4; round++){
+		for (i = 0; i < 600; i++){
+			bump = XCALLOC(1, bump_t);
+			TEST_CHECK(bump && bump->data[2] == 0);
+			bump->data[2] = i;
+		}
+		MM_FAMILY_FREE_ALL(bump_t);
+	}
+
+	TEST_CHECK(mm_get_family_strategy("slot_t") == MM_STRATEGY_SLOTS);
+	TEST_CHECK(mm_get_family_strategy("bump_t") == MM_STRATEGY_BUMP);
+	TEST_CHECK(mm_get_family_strategy("emp_t") == MM_STRATEGY_GENERAL);
+
+	mm_adaptive_strategy_enable(0);
+	mm_flush_deferred_frees();
+	MM_UNREG_STRUCT(bump_t);
+	MM_UNREG_STRUCT(slot_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*Paths carrying the page_alloc and page_free probes : pages added to
+	a family and given back one by one or in bulk. Attach a tracer, e.g.
+	bpftrace -e 'usdt:./exe:mm:page_* { @[probe] = count(); }', to see
+	them fire*/
+static void test_page_probes(){
+
+	int i;
+	size_t resident = 0;
+	scratch_t *scratch = NULL;
+
+	MM_REG_STRUCT(scratch_t);
+	resident = mm_resident_bytes();
+	for (i = 0; i < 100; i++)
+		XCALLOC(1, scratch_t);
+	TEST_CHECK(mm_resident_bytes() > resident);
+
+	MM_FAMILY_FREE_ALL(scratch_t);
+	TEST_CHECK(mm_resident_bytes() == resident);
+
+	scratch = XCALLOC(1, scratch_t);
+	resident = mm_resident_bytes();
+	XFREE(scratch);
+	TEST_CHECK(mm_resident_bytes() < resident);
+	MM_UNREG_STRUCT(scratch_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+static void *test_cpu_cache_fn(void *arg){
+
+	int i, j;
+	node_t *node[32];
+
+	for (i = 0; i < 2000; i++){
+		for (j = 0; j < 32; j++){
+			node[j] = xcalloc_family(arg, 1);
+			TEST_CHECK(node[j] && node[j]->id == 0 && node[j]->next == NULL);
+			node[j]->id = j + 1;
+		}
+		for (j = 0; j < 32; j++){
+			TEST_CHECK(node[j]->id == (uint32_t)j + 1);
+			XFREE(node[j]);
+		}
+	}
+	return NULL;
+}
+
+/*Single objects cycle through the caches of the CPUs the threads run
+	on. Without rseq support the locked paths are used, same results*/
+static void test_cpu_caches(){
+
+	int i;
+	pthread_t threads[4];
+	void *pg_family = mm_page_family_bind("node_t", sizeof(node_t));
+	int status = mm_cpu_cache_enable();
+
+	printf("%s() per-CPU caches %s\n", __FUNCTION__,
+		   status ? "not available" : "enabled");
+	for (i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, test_cpu_cache_fn, pg_family);
+	for (i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+
+	mm_flush_deferred_frees();
+	TEST_CHECK(mm_verify_step(100000) == 0);
+
+	/*A family unregistered with objects parked in its caches gets new
+		caches once registered again*/
+	for (i = 0; i < 2; i++){
+		pg_family = mm_page_family_bind("scratch_t", sizeof(scratch_t));
+		XFREE(xcalloc_family(pg_family, 1));
+		XFREE(xcalloc_family(pg_family, 1));
+		MM_UNREG_STRUCT(scratch_t);
+	}
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct movable_ {
+
+	uint32_t id;
+	char data[60];
+} movable_t;
+
+/*Objects of a sparse relocatable family are moved into fewer pages,
+	their handles still resolve to them*/
+static void test_compaction(){
+
+	int i;
+	uint32_t handle[2000];
+	movable_t *movable = NULL;
+	void *pg_family = MM_REG_RELOCATABLE_STRUCT(movable_t);
+	size_t resident = 0;
+
+	TEST_CHECK(pg_family != NULL);
+	for (i = 0; i < 2000; i++){
+		handle[i] = xcalloc_handle(pg_family);
+		movable = mm_relocatable_ptr(pg_family, handle[i]);
+		TEST_CHECK(movable && movable->id == 0);
+		movable->id = i;
+	}
+
+	/*Keep one object in ten*/
+	for (i = 0; i < 2000; i++)
+		if (i % 10)
+			xfree_handle(pg_family, handle[i]);
+
+	resident = mm_resident_bytes();
+	TEST_CHECK(MM_COMPACT_FAMILY(movable_t) > 0);
+	TEST_CHECK(mm_resident_bytes() < resident);
+
+	for (i = 0; i < 2000; i += 10){
+		movable = mm_relocatable_ptr(pg_family, handle[i]);
+		TEST_CHECK(movable && movable->id == (uint32_t)i);
+		xfree_handle(pg_family, handle[i]);
+	}
+
+	TEST_CHECK(XCALLOC(1, movable_t) == NULL);
+	TEST_CHECK(mm_verify_step(100000) == 0);
+
+	/*Free one object in two hundred : no page can be emptied into the
+		others, compaction gives nothing back and adds no page either*/
+	for (i = 0; i < 2000; i++){
+		handle[i] = xcalloc_handle(pg_family);
+		((movable_t *)mm_relocatable_ptr(pg_family, handle[i]))->id = i;
+	}
+	for (i = 0; i < 2000; i += 200)
+		xfree_handle(pg_family, handle[i]);
+
+	resident = mm_resident_bytes();
+	TEST_CHECK(MM_COMPACT_FAMILY(movable_t) == 0);
+	TEST_CHECK(mm_resident_bytes() == resident);
+
+	for (i = 0; i < 2000; i++){
+		if (i % 200 == 0)
+			continue;
+		movable = mm_relocatable_ptr(pg_family, handle[i]);
+		TEST_CHECK(movable && movable->id == (uint32_t)i);
+		xfree_handle(pg_family, handle[i]);
+	}
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	MM_UNREG_STRUCT(movable_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+typedef struct fresh_ {
+
+	uint64_t data[4];
+} fresh_t;
+
+/*A fresh page hands its objects out in address order, one stride
+	apart. The tail it did not hand out is a free block again once the
+	next page is added*/
+static void test_bump_allocation(){
+
+	int i;
+	fresh_t *fresh[300];
+	ptrdiff_t stride = 0;
+
+	MM_REG_STRUCT(fresh_t);
+	for (i = 0; i < 300; i++){
+		fresh[i] = XCALLOC(1 + (i % 50 == 49), fresh_t);
+		TEST_CHECK(fresh[i] && fresh[i]->data[3] == 0);
+		fresh[i]->data[3] = i;
+	}
+
+	stride = (char *)fresh[1] - (char *)fresh[0];
+	TEST_CHECK(stride > (ptrdiff_t)sizeof(fresh_t));
+	for (i = 1; i < 40; i++)
+		TEST_CHECK((char *)fresh[i] - (char *)fresh[i - 1] == stride);
+
+	for (i = 0; i < 300; i += 2)
+		XFREE(fresh[i]);
+	TEST_CHECK(mm_verify_step(100000) == 0);
+
+	for (i = 0; i < 150; i++){
+		fresh[2 * i] = XCALLOC(1, fresh_t);
+		TEST_CHECK(fresh[2 * i] && fresh[2 * i]->data[3] == 0);
+	}
+	for (i = 0; i < 300; i++){
+		TEST_CHECK(i % 2 == 0 || fresh[i]->data[3] == (uint64_t)i);
+		XFREE(fresh[i]);
+	}
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	mm_print_block_usage();
+	MM_UNREG_STRUCT(fresh_t);
+	printf("%s() done\n", __FUNCTION__);
+}
+
 int main(int argc, char **argv){
 	
 	int wait;
+
+	test_shared_heap();
+	test_persistent_heap();
+	test_in_child(test_page_provider);
+
 	mm_init();
 	MM_REG_STRUCT(emp_t);
 	MM_REG_STRUCT(student_t);
+	MM_REG_STRUCT(node_t);
 	mm_print_registered_page_families();
 
 	emp_t *emp1 = XCALLOC(1, emp_t);
@@ -53,6 +1005,28 @@ int main(int argc, char **argv){
     printf(" \nSCENARIO 3 : *********** \n");
     mm_print_memory_usage(0);
     mm_print_block_usage();
-	
-	return 0;
+
+	printf(" \nFEATURE TESTS : *********** \n");
+	test_arena();
+	test_family_free_all();
+	test_family_bind();
+	test_budget();
+	test_scavenge_span_pages();
+	test_latency();
+	test_deferred_free();
+	test_xmalloc();
+	test_epoch();
+	test_epoch_bulk_release();
+	test_cache_coloring();
+	test_handles();
+	test_span_pages();
+	test_verifier();
+	test_adaptive_strategy();
+	test_page_probes();
+	test_cpu_caches();
+	test_compaction();
+	test_bump_allocation();
+
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
 }
@@ -0,0 +1,163 @@
+#include "uapi_mm.hpp"
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+static int failures;
+
+#define TEST_CHECK(cond)	\
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAILED %s() : %s\n", __FUNCTION__, #cond); \
+		} \
+	} while (0)
+
+struct point
+{
+	int x;
+	int y;
+};
+
+struct other
+{
+	char data[40];
+};
+
+template <typename A, typename B, typename C>
+struct a_type_name_longer_than_a_structure_name
+{
+	A a;
+	B b;
+	C c;
+};
+
+/*Types are keyed by their mangled names, names too long for a family
+	keep a prefix and a hash of the whole name*/
+static void test_type_key()
+{
+	char key[mm::detail::max_struct_name];
+	char other_key[mm::detail::max_struct_name];
+	const char *name = typeid(point).name();
+
+	mm::detail::type_key(key, name);
+	TEST_CHECK(strcmp(key, name) == 0);
+
+	mm::detail::type_key(key,
+		typeid(a_type_name_longer_than_a_structure_name<int, char, long>).name());
+	mm::detail::type_key(other_key,
+		typeid(a_type_name_longer_than_a_structure_name<int, char, short>).name());
+	TEST_CHECK(strlen(key) < mm::detail::max_struct_name);
+	TEST_CHECK(strchr(key, '#') != nullptr);
+	TEST_CHECK(strcmp(key, other_key) != 0);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*A type gets its family on first use, the cached handle is bound again
+	once family records moved*/
+static void test_family()
+{
+	char key[mm::detail::max_struct_name];
+	point *points = nullptr;
+	other *object = nullptr;
+
+	object = mm::family<other>::calloc();
+	TEST_CHECK(object && object->data[39] == 0);
+	mm::family<other>::free(object);
+
+	points = mm::family<point>::calloc(3);
+	TEST_CHECK(points && points[2].x == 0 && points[2].y == 0);
+	points[2].x = 7;
+	TEST_CHECK(mm::family<point>::from_handle(mm::family<point>::handle(points))[2].x == 7);
+	mm::family<point>::free(points);
+
+	mm::detail::type_key(key, typeid(point).name());
+	TEST_CHECK(mm::family<point>::get() == mm_page_family_bind(key, sizeof(point)));
+
+	/*The record of point is moved into the slot of the family
+		unregistered before it*/
+	uint32_t generation = mm_page_family_generation();
+	struct vm_page_family_ *before = mm::family<point>::get();
+
+	mm::detail::type_key(key, typeid(other).name());
+	mm_unregister_page_family(key);
+	TEST_CHECK(mm_page_family_generation() != generation);
+
+	mm::detail::type_key(key, typeid(point).name());
+	TEST_CHECK(mm::family<point>::get() == mm_page_family_bind(key, sizeof(point)));
+	TEST_CHECK(mm::family<point>::get() != before);
+
+	points = mm::family<point>::calloc(2);
+	TEST_CHECK(points && points[1].y == 0);
+	mm::family<point>::free(points);
+	TEST_CHECK(mm::family<point>::max_units() > 100);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*Node based containers get one family per node type*/
+static void test_allocator()
+{
+	int i;
+	long sum = 0;
+	std::list<int, mm::allocator<int> > list;
+	std::map<int, int, std::less<int>, mm::allocator<std::pair<const int, int> > > map;
+
+	for (i = 0; i < 1000; i++)
+	{
+		list.push_back(i);
+		map[i] = 2 * i;
+	}
+
+	for (int value : list)
+		sum += value;
+	TEST_CHECK(sum == 999 * 1000 / 2);
+
+	for (i = 0; i < 1000; i++)
+		TEST_CHECK(map.at(i) == 2 * i);
+
+	for (i = 0; i < 1000; i += 2)
+		map.erase(i);
+	TEST_CHECK(map.size() == 500 && map.find(2) == map.end() && map.at(3) == 6);
+
+	std::vector<point, mm::allocator<point> > points(5000);
+	points[4999].x = 1;
+	TEST_CHECK(points[0].x == 0 && points[4999].x == 1);
+	printf("%s() done\n", __FUNCTION__);
+}
+
+/*Memory resource requests are served by xmalloc, the growing vector
+	goes from size class families to allocations bigger than a page*/
+static void test_memory_resource()
+{
+	int i;
+	mm::memory_resource resource;
+	std::pmr::vector<int> vector(&resource);
+
+	for (i = 0; i < 10000; i++)
+		vector.push_back(i);
+	for (i = 0; i < 10000; i++)
+		TEST_CHECK(vector[i] == i);
+
+	vector.clear();
+	vector.shrink_to_fit();
+	TEST_CHECK(resource.is_equal(resource));
+	TEST_CHECK(!resource.is_equal(*std::pmr::new_delete_resource()));
+	printf("%s() done\n", __FUNCTION__);
+}
+
+int main(int argc, char **argv)
+{
+	mm_init();
+
+	test_type_key();
+	test_family();
+	test_allocator();
+	test_memory_resource();
+
+	TEST_CHECK(mm_verify_step(100000) == 0);
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -2,29 +2,293 @@
 #define __UAPI_MM__
 
 #include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void *xcalloc(char *struct_name, int units);
 
 #define XCALLOC(units, struct_name)	\
 	(xcalloc(#struct_name, units))
 
-void *xfree(void *app_ptr);
+void xfree(void *app_ptr);
 
 #define XFREE(ptr)	\
 	(xfree(ptr))
 
+/*Allocation by size, no registration needed : served from built in
+	size class families created on first use, zero filled, pointer
+	aligned, and released with XFREE like any other object*/
+void *xmalloc(size_t size);
+
+/*Arena (region) allocation, objects allocated in an arena must not
+	be passed to XFREE, they are released together by mm_arena_destroy*/
+typedef struct mm_arena_ mm_arena_t;
+
+mm_arena_t *mm_arena_create();
+
+void *xcalloc_in(mm_arena_t *arena, char *struct_name, int units);
+
+#define XCALLOC_IN(arena, units, struct_name)	\
+	(xcalloc_in(arena, #struct_name, units))
+
+void mm_arena_destroy(mm_arena_t *arena);
+
 /*Initialization Functions*/
 void mm_init();
 
+/*Source of the VM pages of the memory manager. get_pages returns size
+	bytes, a multiple of the system page size, page aligned, or NULL.
+	Pages are zero filled by the memory manager*/
+typedef struct mm_page_provider_
+{
+	void *(*get_pages)(void *ctx, size_t size);
+	void (*return_pages)(void *ctx, void *pages, size_t size);
+	void *ctx;
+} mm_page_provider_t;
+
+/*Use instead of mm_init() to take pages from page_provider, NULL
+	selects the default one : anonymous private mmap, not executable.
+	Ignored by the shared and persistent heap modes*/
+void mm_init_provider(const mm_page_provider_t *page_provider);
+
+/*Shared heap mode : use instead of mm_init() in every cooperating
+	process, the first caller creates the shm segment of heap_size bytes
+	and the others attach to it, returns 0 on success. Structures
+	allocated with XCALLOC are then visible to all processes*/
+int mm_init_shared(char *shm_name, size_t heap_size);
+
+/*Persistent heap mode : use instead of mm_init(), the heap lives in the
+	file at path, created with heap_size bytes when missing, and is
+	reopened as is by later runs. A heap not closed by
+	mm_close_persistent() is checked on open and refused if damaged.
+	The heap may come back at another address : objects must refer to
+	each other by heap offsets and the application finds its data from
+	the heap root. Arenas are not persisted. Returns 0 on success*/
+int mm_init_persistent(char *path, size_t heap_size);
+
+void mm_close_persistent();
+
+/*Offsets are relative to the shared or persistent heap, 0 is NULL*/
+size_t mm_heap_offset(void *ptr);
+
+void *mm_heap_ptr(size_t offset);
+
+void mm_set_heap_root(void *ptr);
+
+void *mm_heap_root();
+
 /*Registration function*/
 void mm_instantiate_new_page_family(char *struct_name, uint32_t struct_size);
 
 #define MM_REG_STRUCT(struct_name) \
 	(mm_instantiate_new_page_family(#struct_name, sizeof(struct_name)))
+
+/*Bulk release : all objects of the family become invalid at once*/
+void mm_family_free_all(char *struct_name);
+
+#define MM_FAMILY_FREE_ALL(struct_name) \
+	(mm_family_free_all(#struct_name))
+
+/*No other thread may allocate or free objects of the family while, or
+	after, it is unregistered, the behaviour is undefined : its per-CPU
+	caches are unmapped and its record is given to another family*/
+void mm_unregister_page_family(char *struct_name);
+
+#define MM_UNREG_STRUCT(struct_name) \
+	(mm_unregister_page_family(#struct_name))
 	
+/*Family handles : bind once, then allocate without the lookup by
+	name. Handles go stale when mm_page_family_generation() changes,
+	which happens whenever a family is unregistered*/
+struct vm_page_family_;
+
+struct vm_page_family_ *mm_page_family_bind(char *struct_name, uint32_t struct_size);
+
+void *xcalloc_family(struct vm_page_family_ *pg_family, int units);
+
+uint32_t mm_max_allocation_size(struct vm_page_family_ *pg_family);
+
+uint32_t mm_page_family_generation();
+
+/*32 bit handles of objects allocated from a family, 0 stands for NULL.
+	A handle stays valid as long as its object, resolving it takes no
+	lock. One pointing past the family's pages resolves to NULL. Not for
+	arena objects, nor xmalloc allocations above a page*/
+uint32_t mm_ptr_to_handle(void *app_ptr);
+
+void *mm_handle_to_ptr(struct vm_page_family_ *pg_family, uint32_t handle);
+
+/*Relocatable families : the application holds 32 bit handles, never
+	pointers, to their objects, so that mm_compact_family() can move the
+	live objects of sparse pages into denser ones and give the emptied
+	pages back. A pointer from mm_relocatable_ptr() is valid until the
+	next compaction of the family, which must not run while other threads
+	use one. Objects are allocated one at a time, zero filled, and never
+	go through XCALLOC or XFREE*/
+struct vm_page_family_ *mm_relocatable_family_bind(char *struct_name, uint32_t struct_size);
+
+#define MM_REG_RELOCATABLE_STRUCT(struct_name) \
+	(mm_relocatable_family_bind(#struct_name, sizeof(struct_name)))
+
+uint32_t xcalloc_handle(struct vm_page_family_ *pg_family);
+
+void *mm_relocatable_ptr(struct vm_page_family_ *pg_family, uint32_t handle);
+
+void xfree_handle(struct vm_page_family_ *pg_family, uint32_t handle);
+
+/*Returns the number of VM pages given back*/
+uint32_t mm_compact_family(char *struct_name);
+
+#define MM_COMPACT_FAMILY(struct_name) \
+	(mm_compact_family(#struct_name))
+
+/*Deferred coalescing : up to max_deferred single object frees of the
+	family are parked and handed out again as is by XCALLOC(1, ...).
+	Parked blocks are merged with their neighbours in one batch when
+	the list is full, when an allocation cannot be satisfied otherwise,
+	by mm_flush_deferred_frees() or by the background scavenger.
+	0, the default, merges every free right away*/
+void mm_set_deferred_free(char *struct_name, uint32_t max_deferred);
+
+#define MM_SET_DEFERRED_FREE(struct_name, max_deferred) \
+	(mm_set_deferred_free(#struct_name, max_deferred))
+
+void mm_flush_deferred_frees();
+
+/*Adaptive allocation strategy, off by default. Once enabled every family
+	watches its own traffic and picks how the pages it adds from then on
+	are used, pages already in use keep their objects where they are :
+	SLOTS    single objects freed one by one, a new page is cut up front
+			 into object sized blocks reused as is (deferred coalescing)
+	BUMP     few individual frees, memory released by mm_family_free_all,
+			 objects come from the untouched tail of the newest page first
+	GENERAL  anything else, best fit split and merge of free blocks, the
+			 tail of the newest page only when no free block fits.
+	An explicit MM_SET_DEFERRED_FREE still applies on top of it*/
+typedef enum
+{
+	MM_STRATEGY_GENERAL,
+	MM_STRATEGY_SLOTS,
+	MM_STRATEGY_BUMP
+} mm_strategy_t;
+
+void mm_adaptive_strategy_enable(int enable);
+
+mm_strategy_t mm_get_family_strategy(char *struct_name);
+
+/*Epoch based reclamation for read mostly structures : readers bracket
+	their traversals with mm_epoch_enter()/mm_epoch_exit() (nestable),
+	writers unlink an object and pass it to xfree_deferred() instead of
+	XFREE. It is freed once every reader that could still see it has
+	left its read section. Reclamation is batched, mm_epoch_reclaim()
+	forces an attempt and returns the number of objects freed; a
+	reader that never leaves its section holds reclamation back. Not
+	available in the shared and persistent heap modes*/
+void mm_epoch_enter();
+
+void mm_epoch_exit();
+
+void xfree_deferred(void *app_ptr);
+
+uint32_t mm_epoch_reclaim();
+
+/*Memory budget in bytes, 0 disables a limit. Below the soft limit empty
+	pages are kept for reuse, above it the scavenger gives them back to
+	the kernel. An allocation needing a new page past a hard limit calls
+	the pressure callback once, then fails with NULL if still over*/
+void mm_set_memory_budget(size_t soft_limit, size_t hard_limit);
+
+void mm_set_family_budget(char *struct_name, size_t hard_limit);
+
+#define MM_SET_FAMILY_BUDGET(struct_name, hard_limit) \
+	(mm_set_family_budget(#struct_name, hard_limit))
+
+/*struct_name is NULL when the pages were requested by an arena, by an
+	xmalloc bigger than a page, or for the memory manager's own use :
+	per-CPU caches, page and object directories, compaction scratch*/
+void mm_set_pressure_callback(void (*pressure_cb)(char *struct_name,
+												  size_t requested_bytes));
+
+size_t mm_resident_bytes();
+
+/*Returns the number of pages given back to the kernel : empty pages,
+	then system pages wholly free inside the VM data pages of families
+	spanning several, which stay counted by mm_resident_bytes()*/
+uint32_t mm_scavenge(uint32_t max_pages);
+
+/*Once enabled the memory manager may be called from several threads
+	of the process, the scavenger and xfree_deferred() enable it*/
+void mm_thread_safe_enable();
+
+/*Per-CPU caches of single objects, filled by XFREE and served to
+	xcalloc_family() and xmalloc() without a lock or an atomic, using
+	restartable sequences : memory held in caches grows with the number
+	of CPUs, not of threads. Returns 0 once enabled, -1 when rseq is not
+	available or in shared heap mode, the locked paths are then used.
+	mm_flush_deferred_frees() and the scavenger empty the caches*/
+int mm_cpu_cache_enable();
+
+/*Background scavenger, it also runs mm_epoch_reclaim()*/
+int mm_scavenger_start(uint32_t interval_ms, uint32_t pages_per_step);
+
+void mm_scavenger_stop();
+
+/*Incremental heap verifier : each step checks at most max_pages VM data
+	pages, resuming where the previous step stopped, and returns the
+	number of problems found. Block links and offsets, free block list
+	membership and order, and unmerged free neighbours are checked.
+	Problems go to the callback, or are printed when none is set*/
+void mm_set_verify_callback(void (*verify_cb)(char *struct_name, void *vm_page,
+											  void *block, char *problem));
+
+uint32_t mm_verify_step(uint32_t max_pages);
+
+int mm_verifier_start(uint32_t interval_ms, uint32_t pages_per_step);
+
+void mm_verifier_stop();
+
+/*Latency instrumentation of xcalloc/xfree, off by default. Durations
+	are recorded per operation and slow path cause, and per family, by
+	each process on its own. Per family histograms restart whenever a
+	family is unregistered*/
+typedef enum
+{
+	MM_LAT_XCALLOC,
+	MM_LAT_XFREE,
+	MM_LAT_OPS
+} mm_lat_op_t;
+
+typedef enum
+{
+	MM_LAT_FAST_PATH,
+	MM_LAT_NEW_PAGE,  /*page added to the family*/
+	MM_LAT_PAGE_FREE, /*page deleted from the family*/
+	MM_LAT_LONG_WALK, /*long free block priority list walk*/
+	MM_LAT_CAUSES,
+	MM_LAT_ANY_CAUSE = MM_LAT_CAUSES
+} mm_lat_cause_t;
+
+void mm_latency_stats_enable(int enable);
+
+void mm_latency_stats_reset();
+
+/*Duration in ns under which percentile % of the operations completed.
+	With a struct_name the family histogram is used and cause ignored*/
+uint64_t mm_latency_percentile(char *struct_name, mm_lat_op_t op,
+							   mm_lat_cause_t cause, double percentile);
+
+void mm_print_latency_stats();
+
 /*Printing Functions*/
 void mm_print_memory_usage(char *struct_name);
 void mm_print_registered_page_families();
 void mm_print_block_usage();
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __UAPI_MM__ */
@@ -0,0 +1,254 @@
+#ifndef __UAPI_MM_HPP__
+#define __UAPI_MM_HPP__
+
+/*C++ front end of the memory manager : every type T gets its own page
+	family, registered on first use under a key derived from the type,
+	and the family handle is cached so allocation skips the lookup by
+	structure name*/
+
+#include "uapi_mm.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <typeinfo>
+#include <atomic>
+#include <mutex>
+#include <memory_resource>
+
+namespace mm
+{
+
+namespace detail
+{
+
+/*MM_MAX_STRUCT_NAME of mm.h*/
+constexpr std::size_t max_struct_name = 32;
+
+/*Blocks handed out by page families are only pointer aligned*/
+constexpr std::size_t max_alignment = alignof(void *);
+
+/*Key a type is registered under : its mangled name, or a prefix of it
+	followed by a hash of the whole name when it does not fit*/
+inline void type_key(char *key, const char *type_name)
+{
+	std::size_t len = std::strlen(type_name);
+
+	if (len < max_struct_name)
+	{
+		std::memcpy(key, type_name, len + 1);
+		return;
+	}
+
+	uint64_t hash = 0xcbf29ce484222325ULL; /*FNV-1a*/
+	for (std::size_t i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)type_name[i]) * 0x100000001b3ULL;
+
+	std::snprintf(key, max_struct_name, "%.14s#%016llx",
+				  type_name, (unsigned long long)hash);
+}
+
+/*Family handle cached per key, re-bound when family records moved.
+	Read without a lock by every thread, bound by one at a time*/
+struct family_handle
+{
+	std::atomic<struct vm_page_family_ *> pg_family{nullptr};
+	std::atomic<uint32_t> generation{0};
+	std::mutex bind_mutex;
+
+	/*nullptr when not bound or stale*/
+	struct vm_page_family_ *current() const
+	{
+		uint32_t bound_generation = generation.load(std::memory_order_acquire);
+		struct vm_page_family_ *bound_family = pg_family.load(std::memory_order_acquire);
+
+		if (!bound_family || bound_generation != mm_page_family_generation())
+			return nullptr;
+		return bound_family;
+	}
+
+	struct vm_page_family_ *bind(char *struct_name, uint32_t struct_size)
+	{
+		std::lock_guard<std::mutex> guard(bind_mutex);
+		struct vm_page_family_ *bound_family = current();
+
+		if (bound_family)
+			return bound_family;
+
+		/*pg_family is published before the generation it is valid for*/
+		uint32_t bound_generation = mm_page_family_generation();
+		bound_family = mm_page_family_bind(struct_name, struct_size);
+		pg_family.store(bound_family, std::memory_order_release);
+		generation.store(bound_generation, std::memory_order_release);
+		return bound_family;
+	}
+};
+
+} // namespace detail
+
+template <typename T>
+class family
+{
+public:
+	static struct vm_page_family_ *get()
+	{
+		static detail::family_handle handle;
+		struct vm_page_family_ *pg_family = handle.current();
+
+		if (pg_family)
+			return pg_family;
+
+		char struct_name[detail::max_struct_name];
+		detail::type_key(struct_name, typeid(T).name());
+		return handle.bind(struct_name, sizeof(T));
+	}
+
+	/*Largest number of T that one allocation from the family can hold*/
+	static std::size_t max_units()
+	{
+		struct vm_page_family_ *pg_family = get();
+
+		if (!pg_family)
+			return 0;
+		return mm_max_allocation_size(pg_family) / sizeof(T);
+	}
+
+	/*Zero filled, like XCALLOC, no constructor is run. nullptr when
+		the family cannot be bound*/
+	static T *calloc(int units = 1)
+	{
+		struct vm_page_family_ *pg_family = get();
+
+		if (!pg_family)
+			return nullptr;
+		return static_cast<T *>(xcalloc_family(pg_family, units));
+	}
+
+	static void free(T *ptr)
+	{
+		xfree(ptr);
+	}
+
+	/*32 bit stand in for a T * allocated from the family*/
+	static uint32_t handle(T *ptr)
+	{
+		return mm_ptr_to_handle(ptr);
+	}
+
+	static T *from_handle(uint32_t handle)
+	{
+		struct vm_page_family_ *pg_family = get();
+
+		if (!pg_family)
+			return nullptr;
+		return static_cast<T *>(mm_handle_to_ptr(pg_family, handle));
+	}
+};
+
+/*std::allocator compatible allocator, node based containers rebind it
+	to their node type and so get one page family per node type. Arrays
+	too big for a family, or over aligned types, go to operator new*/
+template <typename T>
+class allocator
+{
+public:
+	typedef T value_type;
+
+	allocator() noexcept {}
+
+	template <typename U>
+	allocator(const allocator<U> &) noexcept {}
+
+	T *allocate(std::size_t n)
+	{
+		if (!from_family(n))
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+
+		T *ptr = family<T>::calloc((int)n);
+		if (!ptr)
+			throw std::bad_alloc();
+		return ptr;
+	}
+
+	void deallocate(T *ptr, std::size_t n) noexcept
+	{
+		if (!from_family(n))
+		{
+			::operator delete(ptr);
+			return;
+		}
+		family<T>::free(ptr);
+	}
+
+private:
+	static bool from_family(std::size_t n)
+	{
+		return alignof(T) <= detail::max_alignment &&
+			   n <= family<T>::max_units();
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept
+{
+	return false;
+}
+
+/*Polymorphic memory resource on top of xmalloc, so requests are
+	served from its size class families. Over aligned requests go to
+	the upstream resource*/
+class memory_resource : public std::pmr::memory_resource
+{
+public:
+	explicit memory_resource(
+		std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) noexcept
+		: upstream_(upstream) {}
+
+	memory_resource(const memory_resource &) = delete;
+	memory_resource &operator=(const memory_resource &) = delete;
+
+	std::pmr::memory_resource *upstream_resource() const noexcept
+	{
+		return upstream_;
+	}
+
+protected:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		if (alignment > detail::max_alignment)
+			return upstream_->allocate(bytes, alignment);
+
+		void *ptr = xmalloc(bytes);
+		if (!ptr)
+			throw std::bad_alloc();
+		return ptr;
+	}
+
+	void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override
+	{
+		if (alignment > detail::max_alignment)
+		{
+			upstream_->deallocate(ptr, bytes, alignment);
+			return;
+		}
+		xfree(ptr);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+	{
+		return this == &other;
+	}
+
+private:
+	std::pmr::memory_resource *upstream_;
+};
+
+} // namespace mm
+
+#endif /* __UAPI_MM_HPP__ */